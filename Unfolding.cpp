@@ -4,216 +4,3979 @@
 #include <string>
 #include <map>
 #include <set>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <type_traits>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
 #include "nlohmann/json.hpp"
 
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#define popen _popen
+#define pclose _pclose
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UNFOLDING_X86_SIMD 1 // Dostępne jądra SSE4.1/AVX2 wybierane w czasie działania.
+#endif
+
 using namespace std;
 using json = nlohmann::json;
 
 using Matrix = vector<vector<int>>;
 using Marking = vector<int>;
 
+// Liczniki i czasy faz silnika, włączane przy kompilacji flagą -DUNFOLDING_STATS. Bez niej makra
+// STATS_* rozwijają się do pustych instrukcji, więc pomiar nie kosztuje nic. Liczniki są zwiększane
+// tylko w kodzie jednowątkowym (przeszukiwanie DFS/BFS, budowa macierzy wyniku).
+#ifdef UNFOLDING_STATS
+struct EngineStats {
+    size_t markingsVisited = 0;   // Nowe oznakowania (bez początkowego).
+    size_t duplicatesHit = 0;     // Odpalenia prowadzące do odwiedzonego oznakowania.
+    size_t transitionsTested = 0; // Przejścia sprawdzone pod kątem aktywności.
+    size_t transitionsEnabled = 0; // Przejścia, które okazały się aktywne.
+    size_t columnsAdded = 0;      // Kolumny dodane przez addColumn.
+    size_t cycleColumnsAdded = 0; // Kolumny dodane przez addCycleColumn.
+    size_t rowsAdded = 0;         // Wiersze (kopie miejsc) dodane przez addCycleColumn.
+    size_t maxDepth = 0;          // Największa głębokość przeszukiwania (DFS: ramki na stosie, BFS: numer warstwy).
+    double loadSeconds = 0.0;
+    double exploreSeconds = 0.0;
+    double saveSeconds = 0.0;
+};
+
+thread_local EngineStats engineStats; // Osobne dla każdego wątku (tryb wsadowy przetwarza sieci równolegle).
+
+// Dolicza czas życia obiektu do wskazanego pola.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(double& total) : total(total), start(chrono::steady_clock::now()) {}
+    ~PhaseTimer() { total += chrono::duration<double>(chrono::steady_clock::now() - start).count(); }
+
+private:
+    double& total;
+    chrono::steady_clock::time_point start;
+};
+
+// Zeruje liczniki przed ponownym przeszukaniem tej samej sieci, zachowując czas jej wczytania.
+inline void restartEngineStats() {
+    double loadSeconds = engineStats.loadSeconds;
+    engineStats = EngineStats();
+    engineStats.loadSeconds = loadSeconds;
+}
+
+#define STATS_ADD(counter, amount) (engineStats.counter += (amount))
+#define STATS_MAX(counter, value) (engineStats.counter = max<size_t>(engineStats.counter, (value)))
+#define STATS_TIMER(phase) PhaseTimer phase##Timer(engineStats.phase##Seconds)
+#define STATS_DUMP(outputFile) saveStatsToJSON(outputFile)
+#define STATS_RESET() (engineStats = EngineStats())
+#define STATS_RESTART() restartEngineStats()
+#else
+#define STATS_ADD(counter, amount) ((void)0)
+#define STATS_MAX(counter, value) ((void)0)
+#define STATS_TIMER(phase) ((void)0)
+#define STATS_DUMP(outputFile) ((void)0)
+#define STATS_RESET() ((void)0)
+#define STATS_RESTART() ((void)0)
+#endif
+
+// Dynamiczny zbiór bitów (słowa 64-bitowe), rozszerzany przy ustawianiu bitu poza zakresem.
+struct Bitset {
+    vector<uint64_t> words;
+
+    void set(size_t i) {
+        if (i / 64 >= words.size()) {
+            words.resize(i / 64 + 1, 0);
+        }
+        words[i / 64] |= 1ULL << (i % 64);
+    }
+
+    bool test(size_t i) const {
+        return i / 64 < words.size() && ((words[i / 64] >> (i % 64)) & 1ULL);
+    }
+
+    void reset(size_t i) {
+        if (i / 64 < words.size()) {
+            words[i / 64] &= ~(1ULL << (i % 64));
+        }
+    }
+
+    // Najmniejszy ustawiony bit >= from albo SIZE_MAX, gdy takiego nie ma.
+    size_t findNext(size_t from) const {
+        size_t w = from / 64;
+        if (w >= words.size()) {
+            return SIZE_MAX;
+        }
+        uint64_t word = words[w] & (~0ULL << (from % 64));
+        while (true) {
+            if (word) {
+                return w * 64 + __builtin_ctzll(word);
+            }
+            if (++w == words.size()) {
+                return SIZE_MAX;
+            }
+            word = words[w];
+        }
+    }
+
+    // Iloczyn zbiorów; bity poza krótszym zbiorem są zerowane.
+    void andWith(const Bitset& other) {
+        if (words.size() > other.words.size()) {
+            words.resize(other.words.size());
+        }
+        for (size_t w = 0; w < words.size(); ++w) {
+            words[w] &= other.words[w];
+        }
+    }
+
+    void orWith(const Bitset& other) {
+        if (other.words.size() > words.size()) {
+            words.resize(other.words.size(), 0);
+        }
+        for (size_t w = 0; w < other.words.size(); ++w) {
+            words[w] |= other.words[w];
+        }
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t word : words) {
+            total += __builtin_popcountll(word);
+        }
+        return total;
+    }
+
+    // Wywołuje f(i) dla każdego ustawionego bitu w kolejności rosnącej.
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t w = 0; w < words.size(); ++w) {
+            uint64_t word = words[w];
+            while (word) {
+                f(w * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+};
+
+// Rzadka reprezentacja łuków w układzie CSR względem przejść (kolumny macierzy incydencji):
+// łuki przejścia t zajmują zakres [offsets[t], offsets[t + 1]) w tablicach places/weights.
+struct SparseArcs {
+    vector<uint32_t> offsets;     // Początki zakresów (rozmiar = liczba przejść + 1).
+    vector<uint32_t> places;      // Indeksy miejsc połączonych z przejściem.
+    vector<int> weights;          // Wagi łuków.
+
+    size_t begin(size_t t) const { return offsets[t]; }
+    size_t end(size_t t) const { return offsets[t + 1]; }
+};
+
+// Poniżej tej gęstości (niezerowe / wszystkie pola macierzy) silnik używa reprezentacji rzadkiej.
+constexpr double SPARSE_DENSITY_THRESHOLD = 0.25;
+
+// Pojedynczy łuk sieci: miejsce, przejście i waga (liczba tokenów).
+struct Arc {
+    uint32_t place;
+    uint32_t transition;
+    int weight;
+};
+
 struct PetriNet {
-    Matrix incidenceMatrix;       // Macierz incydencji opisująca zależności między miejscami i przejściami.
     Marking initialMarking;       // Oznakowanie początkowe sieci.
     vector<string> places;        // Nazwy miejsc w sieci.
     vector<string> transitions;   // Nazwy przejść w sieci.
+
+    // Transponowana, ciągła reprezentacja przejść (wiersz t ma długość places.size()).
+    vector<int> preByTransition;  // Wagi łuków wejściowych: ile tokenów przejście pobiera z miejsca.
+
+    // Rzadka reprezentacja tych samych łuków (tylko miejsca faktycznie połączone z przejściem).
+    // Pre i Post są przechowywane osobno, więc pętla (miejsce jednocześnie w Pre i Post) nie znika.
+    SparseArcs preSparse;         // Pre: łuki wejściowe (warunek aktywności przejścia).
+    SparseArcs postSparse;        // Post: łuki wyjściowe.
+    bool sparse = false;          // Czy silnik ma używać reprezentacji rzadkiej (mała gęstość sieci).
+
+    // Indeks odwrotny do Pre (CSR względem miejsc): przejścia pobierające tokeny z miejsca p
+    // zajmują zakres [consumerOffsets[p], consumerOffsets[p + 1]) tablicy consumers.
+    vector<uint32_t> consumerOffsets;
+    vector<uint32_t> consumers;
+    vector<int> consumerWeights;  // Waga łuku Pre (miejsce -> przejście) dla każdej pozycji consumers.
+
+    const int* preOf(size_t t) const { return preByTransition.data() + t * places.size(); }
+};
+
+// Buduje tablice CSR z listy łuków (sortowanie po przejściu, a w obrębie przejścia po miejscu).
+// Powtórzone łuki tej samej pary (miejsce, przejście) są scalane w jeden o sumarycznej wadze,
+// tak jak sumują się wpisy gęstych wierszy.
+SparseArcs buildSparseArcs(vector<Arc> arcs, size_t placeCount, size_t transitionCount) {
+    for (const Arc& arc : arcs) {
+        if (arc.place >= placeCount || arc.transition >= transitionCount) {
+            throw runtime_error("Łuk [" + to_string(arc.place) + ", " + to_string(arc.transition) + "] poza siecią o "
+                                + to_string(placeCount) + " miejscach i " + to_string(transitionCount) + " przejściach");
+        }
+    }
+    sort(arcs.begin(), arcs.end(), [](const Arc& a, const Arc& b) {
+        return a.transition != b.transition ? a.transition < b.transition : a.place < b.place;
+    });
+
+    SparseArcs sparse;
+    sparse.offsets.assign(transitionCount + 1, 0);
+    for (size_t i = 0; i < arcs.size(); ++i) {
+        const Arc& arc = arcs[i];
+        if (i > 0 && arcs[i - 1].transition == arc.transition && arcs[i - 1].place == arc.place) {
+            if (sparse.weights.back() > INT32_MAX - arc.weight) {
+                throw runtime_error("Zbyt duża suma wag łuku [" + to_string(arc.place) + ", " + to_string(arc.transition) + "]");
+            }
+            sparse.weights.back() += arc.weight; // Powtórzony łuk.
+            continue;
+        }
+        sparse.offsets[arc.transition + 1]++; // Zliczanie łuków każdego przejścia.
+        sparse.places.push_back(arc.place);
+        sparse.weights.push_back(arc.weight);
+    }
+    for (size_t t = 0; t < transitionCount; ++t) {
+        sparse.offsets[t + 1] += sparse.offsets[t];
+    }
+    return sparse;
+}
+
+// Buduje indeks konsumentów i (dla gęstych sieci) wiersze preByTransition z gotowych tablic CSR.
+// Dla rzadkich sieci gęste wiersze pozostają puste.
+void buildArcIndexes(PetriNet& net) {
+    size_t placeCount = net.places.size();
+    size_t transitionCount = net.transitions.size();
+
+    // Przejścia konsumujące z każdego miejsca (rosnąco według indeksu przejścia).
+    net.consumerOffsets.assign(placeCount + 1, 0);
+    for (uint32_t place : net.preSparse.places) {
+        net.consumerOffsets[place + 1]++;
+    }
+    for (size_t p = 0; p < placeCount; ++p) {
+        net.consumerOffsets[p + 1] += net.consumerOffsets[p];
+    }
+    net.consumers.resize(net.consumerOffsets.back());
+    net.consumerWeights.resize(net.consumerOffsets.back());
+    vector<uint32_t> fill(net.consumerOffsets.begin(), net.consumerOffsets.end() - 1);
+    for (size_t t = 0; t < transitionCount; ++t) {
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            uint32_t slot = fill[net.preSparse.places[k]]++;
+            net.consumers[slot] = static_cast<uint32_t>(t);
+            net.consumerWeights[slot] = net.preSparse.weights[k];
+        }
+    }
+
+    size_t arcCount = net.preSparse.places.size() + net.postSparse.places.size();
+    double cells = static_cast<double>(placeCount) * transitionCount;
+    net.sparse = cells > 0 && arcCount / cells < SPARSE_DENSITY_THRESHOLD;
+    if (net.sparse) {
+        return; // Gęste wiersze nie są potrzebne.
+    }
+
+    net.preByTransition.assign(transitionCount * placeCount, 0);
+    for (size_t t = 0; t < transitionCount; ++t) {
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            net.preByTransition[t * placeCount + net.preSparse.places[k]] = net.preSparse.weights[k];
+        }
+    }
+}
+
+// Buduje reprezentację pre/post przejść z list łuków (jednorazowo po wczytaniu sieci).
+void buildTransitionArrays(PetriNet& net, const vector<Arc>& preArcs, const vector<Arc>& postArcs) {
+    net.preSparse = buildSparseArcs(preArcs, net.places.size(), net.transitions.size());
+    net.postSparse = buildSparseArcs(postArcs, net.places.size(), net.transitions.size());
+    buildArcIndexes(net);
+}
+
+// Macierz (miejsca x przejścia) wczytywana strumieniowo: zapamiętywane są tylko niezerowe wpisy.
+struct DenseSection {
+    bool present = false;
+    size_t rows = 0;
+    size_t columns = 0;           // Długość pierwszego wiersza; pozostałe muszą mieć taką samą.
+    vector<Arc> positive;         // Wpisy dodatnie (waga = wartość).
+    vector<Arc> negative;         // Wpisy ujemne (waga = -wartość).
+};
+
+struct ArcSection {
+    bool present = false;
+    vector<Arc> arcs;
+};
+
+// Wczytywanie sieci w trybie SAX (json::sax_parse): liczby trafiają od razu do list łuków, bez
+// budowania drzewa json i kopii macierzy. Długości wierszy i postać łuków sprawdzane są na bieżąco,
+// a liczba wierszy i indeksy miejsc także na bieżąco, o ile "initialMarking" wystąpiło wcześniej
+// (w przeciwnym razie po wczytaniu całego pliku). Nieznane klucze są pomijane.
+class NetSaxHandler : public nlohmann::json_sax<json> {
+public:
+    Marking initialMarking;
+    bool hasInitialMarking = false;
+    size_t transitionCount = 0;   // Wartość klucza "transitionCount" (formaty z listą łuków).
+    DenseSection pre, post, matrix;
+    ArcSection preArcs, postArcs;
+
+    bool null() override { return invalidValue(); }
+    bool boolean(bool) override { return invalidValue(); }
+    bool number_integer(number_integer_t value) override {
+        if (section == Section::Skip) return true; // Pomijane klucze mogą zawierać dowolne liczby.
+        if (value < -static_cast<number_integer_t>(INT32_MAX)) { // Wartości ujemne macierzy są negowane.
+            throw runtime_error("Zbyt mała liczba w '" + sectionName + "': " + to_string(value));
+        }
+        return number(value);
+    }
+    bool number_unsigned(number_unsigned_t value) override {
+        if (section == Section::Skip) return true;
+        if (value > static_cast<number_unsigned_t>(INT32_MAX)) {
+            throw runtime_error("Zbyt duża liczba w '" + sectionName + "': " + to_string(value));
+        }
+        return number(static_cast<long long>(value));
+    }
+    bool number_float(number_float_t, const string_t&) override {
+        if (section == Section::Skip) return true;
+        throw runtime_error("Oczekiwano liczby całkowitej w '" + sectionName + "'");
+    }
+    bool string(string_t&) override { return invalidValue(); }
+    bool binary(binary_t&) override { return invalidValue(); }
+
+    bool start_object(size_t) override {
+        ++depth;
+        if (depth == 1) return true;
+        if (section == Section::Skip) return true;
+        throw runtime_error("Niepoprawna struktura '" + sectionName + "'");
+    }
+    bool end_object() override {
+        --depth;
+        return true;
+    }
+
+    bool key(string_t& name) override {
+        if (depth != 1) {
+            return true; // Klucze zagnieżdżone należą do pomijanych wartości.
+        }
+        sectionName = name;
+        if (name == "initialMarking") section = Section::InitialMarking;
+        else if (name == "transitionCount") section = Section::TransitionCount;
+        else if (name == "pre") section = Section::Pre;
+        else if (name == "post") section = Section::Post;
+        else if (name == "matrix") section = Section::Matrix;
+        else if (name == "preArcs") section = Section::PreArcs;
+        else if (name == "postArcs") section = Section::PostArcs;
+        else section = Section::Skip;
+        return true;
+    }
+
+    bool start_array(size_t) override {
+        ++depth;
+        if (depth == 1) throw runtime_error("Plik sieci musi zawierać obiekt JSON");
+        if (section == Section::Skip) return true;
+        if (depth == 2) {
+            if (section == Section::TransitionCount) throw runtime_error("Niepoprawna wartość 'transitionCount'");
+            if (section == Section::InitialMarking) {
+                hasInitialMarking = true;
+                initialMarking.clear();
+            }
+            if (DenseSection* dense = denseSection()) {
+                *dense = DenseSection();
+                dense->present = true;
+            }
+            if (ArcSection* arcs = arcSection()) {
+                *arcs = ArcSection();
+                arcs->present = true;
+            }
+            return true;
+        }
+        if (depth == 3 && (denseSection() || arcSection())) {
+            column = 0;
+            entry.clear();
+            return true;
+        }
+        throw runtime_error("Niepoprawna struktura '" + sectionName + "'");
+    }
+
+    bool end_array() override {
+        --depth;
+        if (section == Section::Skip || depth != 2) return true;
+        if (DenseSection* dense = denseSection()) {
+            if (dense->rows == 0) {
+                dense->columns = column;
+            } else if (column != dense->columns) {
+                throw runtime_error("Macierz '" + sectionName + "' ma wiersze o różnej długości");
+            }
+            ++dense->rows;
+            if (hasInitialMarking && dense->rows > initialMarking.size()) {
+                throw runtime_error("Macierz '" + sectionName + "' ma więcej wierszy niż miejsc (" + to_string(initialMarking.size()) + ")");
+            }
+        } else if (ArcSection* arcs = arcSection()) {
+            if (entry.size() < 2 || entry.size() > 3 || entry[0] < 0 || entry[1] < 0 || (entry.size() == 3 && entry[2] <= 0)
+                || (hasInitialMarking && static_cast<size_t>(entry[0]) >= initialMarking.size())) {
+                throw runtime_error("Niepoprawny łuk w '" + sectionName + "': " + describeEntry());
+            }
+            int weight = entry.size() == 3 ? static_cast<int>(entry[2]) : 1;
+            arcs->arcs.push_back({static_cast<uint32_t>(entry[0]), static_cast<uint32_t>(entry[1]), weight});
+        }
+        return true;
+    }
+
+    bool parse_error(size_t position, const std::string&, const nlohmann::detail::exception& error) override {
+        throw runtime_error("Błąd składni JSON (bajt " + to_string(position) + "): " + error.what());
+    }
+
+private:
+    enum class Section { Skip, InitialMarking, TransitionCount, Pre, Post, Matrix, PreArcs, PostArcs };
+
+    Section section = Section::Skip;
+    std::string sectionName;
+    int depth = 0;                // Bieżące zagnieżdżenie (obiekt główny = 1).
+    size_t column = 0;            // Kolumna w bieżącym wierszu macierzy.
+    vector<long long> entry;      // Liczby bieżącego łuku [miejsce, przejście, waga].
+
+    DenseSection* denseSection() {
+        switch (section) {
+            case Section::Pre: return &pre;
+            case Section::Post: return &post;
+            case Section::Matrix: return &matrix;
+            default: return nullptr;
+        }
+    }
+
+    ArcSection* arcSection() {
+        switch (section) {
+            case Section::PreArcs: return &preArcs;
+            case Section::PostArcs: return &postArcs;
+            default: return nullptr;
+        }
+    }
+
+    bool number(long long value) {
+        if (section == Section::Skip) {
+            return true;
+        }
+        if (section == Section::TransitionCount && depth == 1) {
+            if (value < 0) throw runtime_error("Niepoprawna wartość 'transitionCount'");
+            transitionCount = static_cast<size_t>(value);
+        } else if (section == Section::InitialMarking && depth == 2) {
+            if (value < 0) throw runtime_error("Ujemna liczba tokenów w 'initialMarking': " + to_string(value));
+            initialMarking.push_back(static_cast<int>(value));
+        } else if (DenseSection* dense = depth == 3 ? denseSection() : nullptr) {
+            if (value != 0) {
+                Arc arc{static_cast<uint32_t>(dense->rows), static_cast<uint32_t>(column), static_cast<int>(value > 0 ? value : -value)};
+                (value > 0 ? dense->positive : dense->negative).push_back(arc);
+            }
+            ++column;
+        } else if (depth == 3 && arcSection()) {
+            entry.push_back(value);
+        } else {
+            throw runtime_error("Niepoprawna struktura '" + sectionName + "'");
+        }
+        return true;
+    }
+
+    bool invalidValue() {
+        if (section == Section::Skip || depth == 0) {
+            if (depth == 0) throw runtime_error("Plik sieci musi zawierać obiekt JSON");
+            return true;
+        }
+        throw runtime_error("Niepoprawna wartość w '" + sectionName + "'");
+    }
+
+    std::string describeEntry() const {
+        std::string text = "[";
+        for (size_t i = 0; i < entry.size(); ++i) {
+            text += (i ? ", " : "") + to_string(entry[i]);
+        }
+        return text + "]";
+    }
+};
+
+// Sprawdza wymiary macierzy wczytanej z pliku (wiersze = miejsca, kolumny = przejścia).
+void checkMatrixDimensions(const DenseSection& matrix, size_t rows, size_t columns, const string& name) {
+    if (matrix.rows != rows) {
+        throw runtime_error("Macierz '" + name + "' ma " + to_string(matrix.rows) + " wierszy, oczekiwano " + to_string(rows));
+    }
+    if (rows > 0 && matrix.columns != columns) {
+        throw runtime_error("Macierz '" + name + "' ma wiersze o różnej długości");
+    }
+}
+
+// Sprawdza indeksy miejsc łuków, gdy "initialMarking" wystąpiło w pliku po liście łuków.
+void checkArcPlaces(const vector<Arc>& arcs, size_t placeCount, const string& name) {
+    for (const Arc& arc : arcs) {
+        if (arc.place >= placeCount) {
+            throw runtime_error("Niepoprawny łuk w '" + name + "': [" + to_string(arc.place) + ", " + to_string(arc.transition) + ", " + to_string(arc.weight) + "]");
+        }
+    }
+}
+
+struct LoadStats {
+    size_t bytes = 0;             // Rozmiar pliku.
+    double seconds = 0.0;         // Czas parsowania i budowy sieci.
 };
 
-PetriNet loadFromJSON(const string& filename) {
-    ifstream file(filename);      // Otwiera plik JSON do odczytu.
-    json j;                       // Tworzy obiekt JSON.
-    file >> j;                    // Wczytuje dane z pliku do obiektu JSON.
+// Obsługiwane formaty wejścia:
+//   "matrix"                 - macierz incydencji (Post - Pre), bez możliwości zapisania pętli,
+//   "pre" i "post"           - osobne macierze Pre i Post (miejsca x przejścia),
+//   "preArcs" i "postArcs"   - listy łuków [miejsce, przejście, waga], opcjonalnie "transitionCount".
+// W każdym przypadku "initialMarking" wyznacza liczbę miejsc.
+PetriNet loadFromJSON(const string& filename, LoadStats* stats = nullptr) {
+    STATS_TIMER(load);
+    auto start = chrono::steady_clock::now();
+    unique_ptr<FILE, int (*)(FILE*)> file(fopen(filename.c_str(), "rb"), fclose); // Otwiera plik JSON do odczytu.
+    if (!file) {
+        throw runtime_error("Nie można otworzyć pliku wejściowego: " + filename);
+    }
+    setvbuf(file.get(), nullptr, _IOFBF, 1 << 20);
+
+    NetSaxHandler handler;        // Wypełnia listy łuków w trakcie parsowania.
+    json::sax_parse(file.get(), &handler);
+    if (!handler.hasInitialMarking) {
+        throw runtime_error("Brak 'initialMarking' w pliku " + filename);
+    }
 
     PetriNet net;                 // Tworzy obiekt sieci Petriego.
-    net.incidenceMatrix = j["matrix"].get<Matrix>(); // Wczytuje macierz incydencji.
-    net.initialMarking = j["initialMarking"].get<Marking>(); // Wczytuje oznakowanie początkowe.
+    net.initialMarking = move(handler.initialMarking); // Oznakowanie początkowe.
 
-    int placeCount = net.incidenceMatrix.size(); // Liczba miejsc (wiersze macierzy).
-    int transitionCount = net.incidenceMatrix[0].size(); // Liczba przejść (kolumny macierzy).
+    size_t placeCount = net.initialMarking.size(); // Liczba miejsc.
+    size_t transitionCount = 0;                    // Liczba przejść.
+    vector<Arc> preArcs, postArcs;
+
+    if (handler.pre.present && handler.post.present) {
+        transitionCount = handler.pre.rows ? handler.pre.columns : 0;
+        checkMatrixDimensions(handler.pre, placeCount, transitionCount, "pre");
+        checkMatrixDimensions(handler.post, placeCount, transitionCount, "post");
+        preArcs = move(handler.pre.positive);
+        postArcs = move(handler.post.positive);
+    } else if (handler.preArcs.present && handler.postArcs.present) {
+        transitionCount = handler.transitionCount;
+        preArcs = move(handler.preArcs.arcs);
+        postArcs = move(handler.postArcs.arcs);
+        checkArcPlaces(preArcs, placeCount, "preArcs");
+        checkArcPlaces(postArcs, placeCount, "postArcs");
+        for (const vector<Arc>* arcs : {&preArcs, &postArcs}) {
+            for (const Arc& arc : *arcs) {
+                transitionCount = max<size_t>(transitionCount, arc.transition + 1);
+            }
+        }
+    } else if (handler.matrix.present) {
+        transitionCount = handler.matrix.rows ? handler.matrix.columns : 0; // Liczba przejść (kolumny macierzy).
+        checkMatrixDimensions(handler.matrix, placeCount, transitionCount, "matrix");
+        preArcs = move(handler.matrix.negative); // Wartości ujemne to łuki wejściowe.
+        postArcs = move(handler.matrix.positive); // Wartości dodatnie to łuki wyjściowe.
+    } else {
+        throw runtime_error("Brak sieci w pliku " + filename + ": oczekiwano 'matrix', 'pre' i 'post' albo 'preArcs' i 'postArcs'");
+    }
 
     // Generuje nazwy miejsc w formacie p1, p2, ...
-    for (int i = 1; i <= placeCount; ++i) {
+    for (size_t i = 1; i <= placeCount; ++i) {
         net.places.push_back("p" + to_string(i));
     }
 
     // Generuje nazwy przejść w formacie t1, t2, ...
-    for (int i = 1; i <= transitionCount; ++i) {
+    for (size_t i = 1; i <= transitionCount; ++i) {
         net.transitions.push_back("t" + to_string(i));
     }
 
+    buildTransitionArrays(net, preArcs, postArcs); // Przygotowuje reprezentację pre/post dla przejść.
+
+    if (stats) {
+        fseek(file.get(), 0, SEEK_END);
+        stats->bytes = static_cast<size_t>(ftell(file.get()));
+        stats->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
     return net; // Zwraca wczytaną sieć Petriego.
 }
 
-void saveToJSON(const string& filename, const Matrix& matrix, const vector<string>& places, const vector<string>& transitions) {
-    json j;                       // Tworzy obiekt JSON.
-    j["matrix"] = matrix;         // Dodaje macierz do obiektu JSON.
-    j["Place"] = places;          // Dodaje miejsca do obiektu JSON.
-    j["Transition"] = transitions; // Dodaje przejścia do obiektu JSON.
-
-    ofstream file(filename);      // Otwiera plik JSON do zapisu.
-    file << j.dump(4);            // Zapisuje dane w formacie JSON z wcięciem 4 spacji.
-}
+// Strumieniowy zapis JSON: elementy trafiają od razu do bufora i do pliku, bez budowania drzewa json.
+// W trybie z wcięciami wynik jest identyczny z json::dump(4) (klucze należy podawać w porządku
+// alfabetycznym, jak w std::map), w trybie zwartym - z json::dump(). Strumieniowany jest tylko zapis:
+// dane, z których powstaje wynik (np. macierz silnika DFS), są już w pamięci przed jego rozpoczęciem.
+// Zapis kończy close(), które zgłasza błąd strumienia (np. brak miejsca na dysku) wyjątkiem.
+class JsonStreamWriter {
+public:
+    JsonStreamWriter(const string& filename, bool compact)
+        : file(filename, ios::binary), filename(filename), compact(compact) {
+        if (!file) {
+            throw runtime_error("Nie można otworzyć pliku wyjściowego: " + filename);
+        }
+        buffer.reserve(BUFFER_SIZE);
+    }
 
-// Sprawdzenie czy moze zostac uruchomiona tranzycja
-bool isTransitionEnabled(const Marking& marking, const vector<int>& transition) {
-    for (size_t i = 0; i < transition.size(); ++i) { // Iteruje przez wszystkie indeksy w transition.
-        if (transition[i] < 0) { // Sprawdza, czy wartość jest ujemna.
-            if (marking[i] < -transition[i]) { // Sprawdza, czy marking[i] spełnia warunek.
-                return false; // Jeśli marking[i] jest za mały, przejście jest zablokowane.
-            }
+    // Bez close() (wyjątek w trakcie zapisu) reszta bufora jest zapisywana bez sprawdzania błędów.
+    ~JsonStreamWriter() {
+        if (file.is_open()) {
+            file.write(buffer.data(), buffer.size());
         }
     }
-    return true; // Jeśli wszystkie warunki są spełnione, przejście jest aktywne.
-}
 
-// Przeniesienie tokenów po uruchomieniu
-Marking fireTransition(const Marking& marking, const vector<int>& transition) {
+    JsonStreamWriter(const JsonStreamWriter&) = delete;
+    JsonStreamWriter& operator=(const JsonStreamWriter&) = delete;
+
+    void beginObject() { beginValue(); open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { beginValue(); open('['); }
+    void endArray() { close(']'); }
 
-    // Tworzenie kopii oznakowania
-    Marking newMarking(marking.size(), 0);
-    for (size_t i = 0; i < marking.size(); ++i) {
-        newMarking[i] = marking[i] + transition[i]; // Dodanie wartości z transition
+    void key(const string& name) {
+        separate();
+        writeString(name);
+        append(compact ? ":" : ": ");
+        keyPending = true;
     }
 
-    return newMarking; // Zwróć poprawnie zaktualizowane oznakowanie
-}
+    void value(long long number) {
+        beginValue();
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), number);
+        append(digits, result.ptr - digits);
+    }
+
+    void value(const string& text) {
+        beginValue();
+        writeString(text);
+    }
+
+    // Tablica liczb w jednym wywołaniu (wiersz macierzy, oznakowanie).
+    template <typename Number>
+    void numberArray(const Number* numbers, size_t count) {
+        beginArray();
+        for (size_t i = 0; i < count; ++i) {
+            value(static_cast<long long>(numbers[i]));
+        }
+        endArray();
+    }
+
+    void stringArray(const vector<string>& texts) {
+        beginArray();
+        for (const string& text : texts) {
+            value(text);
+        }
+        endArray();
+    }
 
+    void flush() {
+        file.write(buffer.data(), buffer.size());
+        buffer.clear();
+        if (!file) {
+            throw runtime_error("Błąd zapisu pliku wyjściowego: " + filename);
+        }
+    }
+
+    // Zapisuje resztę bufora i zamyka plik.
+    void close() {
+        flush();
+        file.close();
+        if (!file) {
+            throw runtime_error("Błąd zapisu pliku wyjściowego: " + filename);
+        }
+    }
 
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
 
+    ofstream file;
+    string filename;
+    bool compact;
+    string buffer;
+    vector<size_t> elementCounts; // Liczba elementów w każdym otwartym kontenerze.
+    bool keyPending = false;      // Właśnie zapisano klucz, więc wartość idzie bez separatora.
 
-// Dodawanie wypelnionych kolumn nowej macierzy
-void addTransitionColumn(Matrix& matrix, const Marking& newMarking, const vector<Marking>& historyMarking, size_t transitionIndex) {
-    // Pobierz ostatnie oznakowanie z historii jako "previousMarking"
-    const Marking& previousMarking = historyMarking.back();
+    void append(const char* text, size_t length) {
+        buffer.append(text, length);
+        if (buffer.size() >= BUFFER_SIZE) {
+            flush();
+        }
+    }
+    void append(const char* text) { append(text, strlen(text)); }
 
-    // Obliczamy różnicę między newMarking i previousMarking
-    vector<int> newColumn(newMarking.size(), 0);
-    for (size_t i = 0; i < newMarking.size(); ++i) {
-        newColumn[i] = newMarking[i] - previousMarking[i];
+    void newline(size_t depth) {
+        if (!compact) {
+            buffer.push_back('\n');
+            buffer.append(depth * 4, ' ');
+        }
     }
 
-    // Jeśli macierz jest pusta, inicjalizujemy ją
-    if (matrix.empty()) {
-        for (size_t i = 0; i < newMarking.size(); ++i) {
-            matrix.push_back({newColumn[i]});
+    // Separator przed kolejnym elementem kontenera (przecinek i wcięcie).
+    void separate() {
+        if (elementCounts.empty()) {
+            return;
         }
-    } else {
-        // Dodajemy nową kolumnę do istniejącej macierzy
-        for (size_t i = 0; i < matrix.size(); ++i) {
-            matrix[i].push_back(newColumn[i]);
+        if (elementCounts.back()++ > 0) {
+            buffer.push_back(',');
         }
+        newline(elementCounts.size());
     }
-}
 
-// Dodawanie wypełnionych kolumny w nowej macierzy wraz z dodaniem nowych wierszy ze wzgledu na duplikaty
-void addTransitionColumn_CYCLE(Matrix& matrix, const Marking& newMarking, const vector<Marking>& historyMarking, size_t transitionIndex) {
-    // Pobierz ostatnie oznakowanie z historii jako "previousMarking"
-    const Marking& previousMarking = historyMarking.back();
+    void beginValue() {
+        if (keyPending) {
+            keyPending = false;
+        } else {
+            separate();
+        }
+    }
 
-    // Obliczamy różnicę między newMarking i previousMarking
-    vector<int> newColumn(newMarking.size(), 0);
-    for (size_t i = 0; i < newMarking.size(); ++i) {
-        newColumn[i] = newMarking[i] - previousMarking[i];
+    void open(char bracket) {
+        buffer.push_back(bracket);
+        elementCounts.push_back(0);
     }
 
-    // Dodanie nowej kolumny do istniejącej macierzy
-    if (matrix.empty()) {
-        for (size_t i = 0; i < newMarking.size(); ++i) {
-            matrix.push_back({newColumn[i]}); // Jeśli macierz jest pusta, inicjalizuj ją z newColumn.
+    void close(char bracket) {
+        size_t count = elementCounts.back();
+        elementCounts.pop_back();
+        if (count > 0) {
+            newline(elementCounts.size());
         }
-    } else {
-        for (size_t i = 0; i < matrix.size(); ++i) {
-            matrix[i].push_back(newColumn[i]); // Dodaj nową kolumnę do istniejącej macierzy.
+        append(&bracket, 1);
+    }
+
+    void writeString(const string& text) {
+        buffer.push_back('"');
+        for (char c : text) {
+            switch (c) {
+                case '"': buffer.append("\\\""); break;
+                case '\\': buffer.append("\\\\"); break;
+                case '\b': buffer.append("\\b"); break;
+                case '\f': buffer.append("\\f"); break;
+                case '\n': buffer.append("\\n"); break;
+                case '\r': buffer.append("\\r"); break;
+                case '\t': buffer.append("\\t"); break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        buffer.append(escaped);
+                    } else {
+                        buffer.push_back(c);
+                    }
+            }
         }
+        append("\"");
+    }
+};
+
+// Haszowanie Zobrista: hasz oznakowania to XOR kluczy (miejsce, liczba tokenów) po miejscach z niezerową
+// liczbą tokenów. Klucz powstaje z mieszania splitmix64 zamiast z tablicy losowych liczb, bo liczba tokenów
+// nie jest ograniczona. Zmiana liczby tokenów w jednym miejscu to dwa XOR-y, więc odpalenie przejścia
+// aktualizuje hasz w O(|•t| + |t•|) bez ponownego przechodzenia całego oznakowania.
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27; x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t zobristKey(size_t place, int tokens) {
+    if (tokens == 0) {
+        return 0; // Puste miejsca nie wpływają na hasz, więc oznakowanie upakowane ma ten sam hasz.
+    }
+    return mix64(((static_cast<uint64_t>(place) << 32) | static_cast<uint32_t>(tokens)) + 0x9E3779B97F4A7C15ULL);
+}
+
+// Dodaje delta tokenów do miejsca p, aktualizując hasz oznakowania.
+inline void addTokensHashed(Marking& marking, uint64_t& hash, uint32_t p, int delta) {
+    hash ^= zobristKey(p, marking[p]);
+    marking[p] += delta;
+    hash ^= zobristKey(p, marking[p]);
+}
+
+// Aktualizuje hasz oznakowania upakowanego o bity, które zmieniły się w słowie w (changed = stare ^ nowe).
+inline void toggleBitsHashed(uint64_t& hash, size_t w, uint64_t changed) {
+    while (changed) {
+        hash ^= zobristKey(w * 64 + __builtin_ctzll(changed), 1);
+        changed &= changed - 1;
     }
+}
 
-    // Sprawdzanie liczb dodatnich w newColumn
-    for (size_t i = 0; i < newColumn.size(); ++i) {
-        if (newColumn[i] > 0) { // Znaleziono liczbę dodatnią
-            int transfer_connect = newColumn[i]; // Przechowujemy wartość dodatnią
+// Magazyn odwiedzonych oznakowań (interning): każde różne oznakowanie zapisane jest raz w ciągłej
+// arenie i dostaje 32-bitowy identyfikator (kolejność wstawienia). Oznakowanie id zajmuje
+// [id * width, (id + 1) * width) areny, bez osobnej alokacji i nagłówka wektora na oznakowanie.
+// Id odszukuje tablica haszująca z adresowaniem otwartym (sondowanie liniowe). Hasz oznakowania jest
+// zapamiętywany; można go podać przy wstawianiu (utrzymywany przyrostowo przy odpalaniu), a bez niego
+// liczony jest od zera. Wszystkie oznakowania w magazynie mają tę samą długość.
+// Token to typ elementu oznakowania: int dla zwykłych oznakowań, uint64_t dla upakowanych bitowo.
+template <typename Token>
+class BasicMarkingStore {
+public:
+    using Value = vector<Token>;
 
-            // **Poprawka: Zmieniamy wartość w macierzy na 0**
-            matrix[i].back() = 0;
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX; // Znacznik pustego slotu w tablicy.
 
-            // Tworzymy nowy wiersz i wypełniamy go zerami
-            vector<int> newRow(matrix[0].size(), 0);
+    struct Stats {
+        size_t lookups = 0;       // Liczba wyszukiwań (find + insert).
+        size_t probes = 0;        // Łączna liczba odwiedzonych slotów.
+        size_t maxProbe = 0;      // Najdłuższa sekwencja sondowania.
+        size_t rehashes = 0;      // Liczba powiększeń tablicy.
+    };
 
-            // W nowej kolumnie wpisujemy wartość transfer_connect
-            newRow.back() = transfer_connect;
+    explicit BasicMarkingStore(size_t expectedMarkings = 1024) {
+        size_t capacity = 16;
+        while (capacity * MAX_LOAD_NUM < expectedMarkings * MAX_LOAD_DEN) {
+            capacity *= 2;
+        }
+        slots.assign(capacity, EMPTY_SLOT);
+    }
 
-            // Dodajemy nowy wiersz do macierzy
-            matrix.push_back(newRow);
+    // Pełny hasz Zobrista; oznakowanie upakowane ma ten sam hasz co rozpakowane.
+    static uint64_t hashMarking(const Value& marking) {
+        uint64_t h = 0;
+        if constexpr (is_same_v<Token, uint64_t>) {
+            for (size_t w = 0; w < marking.size(); ++w) {
+                toggleBitsHashed(h, w, marking[w]);
+            }
+        } else {
+            for (size_t p = 0; p < marking.size(); ++p) {
+                h ^= zobristKey(p, marking[p]);
+            }
         }
+        return h;
     }
-}
 
+    // Wstawia oznakowanie, jeśli go jeszcze nie ma. Zwraca {id, czy było nowe}.
+    pair<uint32_t, bool> insert(const Value& marking) {
+        return insert(marking, hashMarking(marking));
+    }
 
+    // Jak wyżej, z haszem równym hashMarking(marking) policzonym przez wywołującego.
+    pair<uint32_t, bool> insert(const Value& marking, uint64_t hash) {
+        size_t slot = probe(marking, hash);
+        if (slots[slot] != EMPTY_SLOT) {
+            return {slots[slot], false}; // Oznakowanie już istnieje.
+        }
 
+        if (hashes.empty()) {
+            width = marking.size();
+        } else if (marking.size() != width) {
+            throw runtime_error("Oznakowanie o długości " + to_string(marking.size()) + " w magazynie oznakowań o długości " + to_string(width));
+        }
+        uint32_t id = static_cast<uint32_t>(hashes.size());
+        arena.insert(arena.end(), marking.begin(), marking.end());
+        hashes.push_back(hash);
+        slots[slot] = id;
 
-void unfoldRecursively(const PetriNet& net, const Marking& currentMarking, vector<Marking>& markingHistory, Matrix& resultMatrix, vector<string>& resultPlaces, vector<string>& resultTransitions, map<string, int>& duplicateCounts, size_t currentTransition = 0) {
-    for (size_t t = currentTransition; t < net.transitions.size(); ++t) { // Rozpoczynamy od `currentTransition`
-        vector<int> transition;
-        for (size_t p = 0; p < net.places.size(); ++p) {
-            transition.push_back(net.incidenceMatrix[p][t]); // Pobiera kolumnę macierzy dla danego przejścia.
+        if (hashes.size() * MAX_LOAD_DEN > slots.size() * MAX_LOAD_NUM) {
+            grow();
         }
+        return {id, true};
+    }
 
-        if (isTransitionEnabled(currentMarking, transition)) { // Sprawdza, czy przejście jest aktywne.
-            Marking newMarking = fireTransition(currentMarking, transition); // Wykonuje przejście.
+    // Oznakowanie o danym id: width kolejnych elementów areny (wskaźnik ważny do następnego insert).
+    const Token* marking(uint32_t id) const { return arena.data() + static_cast<size_t>(id) * width; }
+    uint64_t hashOf(uint32_t id) const { return hashes[id]; }
+    size_t size() const { return hashes.size(); }
+    size_t capacity() const { return slots.size(); }
+    double loadFactor() const { return static_cast<double>(hashes.size()) / slots.size(); }
+    double averageProbes() const { return stats.lookups ? static_cast<double>(stats.probes) / stats.lookups : 0.0; }
+    const Stats& statistics() const { return stats; }
 
-            bool foundDuplicate = false;
-            for (auto& previousMarking : markingHistory) {
-                if (previousMarking == newMarking) {
-                    foundDuplicate = true; // Sprawdza, czy oznakowanie już istnieje.
-                    break;
-                }
+    // Przybliżona pamięć zajmowana przez arenę, hasze i tablicę (w bajtach).
+    size_t memoryUsage() const {
+        return arena.capacity() * sizeof(Token) + hashes.capacity() * sizeof(uint64_t)
+             + slots.size() * sizeof(uint32_t);
+    }
+
+private:
+    // Maksymalny współczynnik wypełnienia 0.7 (jako ułamek, żeby uniknąć liczb zmiennoprzecinkowych).
+    static constexpr size_t MAX_LOAD_NUM = 7;
+    static constexpr size_t MAX_LOAD_DEN = 10;
+
+    size_t width = 0;             // Długość oznakowania (ustalana przy pierwszym wstawieniu).
+    vector<Token> arena;          // Oznakowania w kolejności wstawienia, jedno za drugim.
+    vector<uint64_t> hashes;      // Zapamiętane hasze oznakowań (indeks = id).
+    vector<uint32_t> slots;       // Tablica haszująca przechowująca id oznakowań.
+    mutable Stats stats;
+
+    // Zwraca slot z danym oznakowaniem albo pierwszy pusty slot na jego ścieżce sondowania.
+    size_t probe(const Value& marking, uint64_t hash) const {
+        size_t mask = slots.size() - 1;
+        size_t slot = hash & mask;
+        size_t length = 1;
+        while (slots[slot] != EMPTY_SLOT) {
+            uint32_t id = slots[slot];
+            if (hashes[id] == hash && marking.size() == width && equal(marking.begin(), marking.end(), this->marking(id))) {
+                break;
             }
+            slot = (slot + 1) & mask;
+            ++length;
+        }
+        stats.lookups++;
+        stats.probes += length;
+        stats.maxProbe = max(stats.maxProbe, length);
+        return slot;
+    }
 
-            if (foundDuplicate) {
-                addTransitionColumn_CYCLE(resultMatrix, newMarking, markingHistory, t);
+    // Podwaja tablicę i rozmieszcza id ponownie na podstawie zapamiętanych haszy.
+    void grow() {
+        vector<uint32_t> newSlots(slots.size() * 2, EMPTY_SLOT);
+        size_t mask = newSlots.size() - 1;
+        for (uint32_t id = 0; id < hashes.size(); ++id) {
+            size_t slot = hashes[id] & mask;
+            while (newSlots[slot] != EMPTY_SLOT) {
+                slot = (slot + 1) & mask;
+            }
+            newSlots[slot] = id;
+        }
+        slots.swap(newSlots);
+        stats.rehashes++;
+    }
+};
 
-                continue;
-            } else { // Jeśli nie znaleziono duplikatu, dodaje nowe węzły.
+using MarkingStore = BasicMarkingStore<int>;             // Oznakowania ogólne (liczby tokenów).
+using PackedMarkingStore = BasicMarkingStore<uint64_t>;  // Oznakowania sieci bezpiecznych (bity).
 
-                if (!markingHistory.empty()) {
-                    // Dodanie nowej kolumny do macierzy na podstawie różnicy newMarking i ostatniego historyMarking
-                    addTransitionColumn(resultMatrix, newMarking, markingHistory, t);
-                }
+// Jądra sprawdzenia aktywności na gęstych oznakowaniach (wektory int o długości n). Wersje AVX2 i SSE4.1
+// porównują po 8 lub 4 miejsca naraz; wybór następuje raz, w czasie działania, na podstawie CPU.
+bool enabledScalar(const int* marking, const int* pre, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (marking[i] < pre[i]) {
+            return false;
+        }
+    }
+    return true;
+}
 
-                // Dodanie newMarking do historii oznakowań
-                markingHistory.push_back(newMarking);
+#ifdef UNFOLDING_X86_SIMD
+__attribute__((target("sse4.1")))
+bool enabledSse4(const int* marking, const int* pre, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(marking + i));
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pre + i));
+        __m128i lacking = _mm_cmpgt_epi32(p, m); // pre > marking na którymkolwiek miejscu blokuje przejście.
+        if (!_mm_testz_si128(lacking, lacking)) {
+            return false;
+        }
+    }
+    return enabledScalar(marking + i, pre + i, n - i);
+}
 
-                // Wywołanie rekurencyjne rozpoczynające się od następnego przejścia
-                unfoldRecursively(net, newMarking, markingHistory, resultMatrix, resultPlaces, resultTransitions, duplicateCounts, t + 1);
-            }
+__attribute__((target("avx2")))
+bool enabledAvx2(const int* marking, const int* pre, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(marking + i));
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pre + i));
+        __m256i lacking = _mm256_cmpgt_epi32(p, m);
+        if (!_mm256_testz_si256(lacking, lacking)) {
+            return false;
         }
     }
+    return enabledScalar(marking + i, pre + i, n - i);
 }
 
-pair<Matrix, pair<vector<string>, vector<string>>> unfolding(const PetriNet& net) {
-    Matrix resultMatrix; // Początkowo pusta macierz wynikowa.
-    vector<string> resultPlaces; // Początkowo pusta lista miejsc.
-    vector<string> resultTransitions; // Początkowo pusta lista przejść.
+#endif
 
-    vector<Marking> markingHistory = {net.initialMarking}; // Historia oznakowań z początkowym oznakowaniem.
-    map<string, int> duplicateCounts; // Licznik duplikatów dla miejsc i przejść.
+struct DenseKernels {
+    const char* name;
+    bool (*enabled)(const int* marking, const int* pre, size_t n);
+};
 
-    unfoldRecursively(net, net.initialMarking, markingHistory, resultMatrix, resultPlaces, resultTransitions, duplicateCounts);
+// Wszystkie warianty obsługiwane przez bieżący procesor, od najszybszego.
+vector<DenseKernels> availableDenseKernels() {
+    vector<DenseKernels> kernels;
+#ifdef UNFOLDING_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"AVX2", enabledAvx2});
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernels.push_back({"SSE4.1", enabledSse4});
+    }
+#endif
+    kernels.push_back({"skalarne", enabledScalar});
+    return kernels;
+}
 
-    return {resultMatrix, {resultPlaces, resultTransitions}}; // Zwraca macierz wynikową i odpowiadające listy.
+const DenseKernels& denseKernels() {
+    static const DenseKernels selected = availableDenseKernels().front();
+    return selected;
 }
 
-int main() {
-    string inputFile = "input.json"; // Plik wejściowy JSON.
-    string outputFile = "output.json"; // Plik wyjściowy JSON.
+// Sprawdzenie wsadowe (wersja gęsta): jedno oznakowanie względem wszystkich przejść, których wiersze
+// Pre leżą kolejno w tablicy pre (wiersz t zaczyna się od pre + t * placeCount). Wynik to zbiór bitów.
+void enabledTransitionsDense(const DenseKernels& kernels, const int* marking, const int* pre, size_t placeCount,
+                             size_t transitionCount, Bitset& enabled) {
+    enabled.words.assign((transitionCount + 63) / 64, 0);
+    for (size_t t = 0; t < transitionCount; ++t) {
+        if (kernels.enabled(marking, pre + t * placeCount, placeCount)) {
+            enabled.set(t);
+        }
+    }
+}
+
+void enabledTransitionsDense(const PetriNet& net, const Marking& marking, Bitset& enabled) {
+    enabledTransitionsDense(denseKernels(), marking.data(), net.preByTransition.data(), net.places.size(), net.transitions.size(), enabled);
+}
+
+// Sprawdzenie czy moze zostac uruchomiona tranzycja (wersja rzadka, tylko miejsca wejściowe)
+bool isTransitionEnabledSparse(const PetriNet& net, const Marking& marking, size_t t) {
+    const SparseArcs& pre = net.preSparse;
+    for (size_t k = pre.begin(t); k < pre.end(t); ++k) {
+        if (marking[pre.places[k]] < pre.weights[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Odpalenie w miejscu (marking += Post - Pre) i jego cofnięcie; zmieniają tylko miejsca łuków t
+// i przy okazji aktualizują hasz Zobrista oznakowania.
+void applyTransition(const PetriNet& net, Marking& marking, size_t t, uint64_t& hash) {
+    for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+        addTokensHashed(marking, hash, net.preSparse.places[k], -net.preSparse.weights[k]);
+    }
+    for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+        addTokensHashed(marking, hash, net.postSparse.places[k], net.postSparse.weights[k]);
+    }
+}
+
+void undoTransition(const PetriNet& net, Marking& marking, size_t t, uint64_t& hash) {
+    for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+        addTokensHashed(marking, hash, net.postSparse.places[k], -net.postSparse.weights[k]);
+    }
+    for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+        addTokensHashed(marking, hash, net.preSparse.places[k], net.preSparse.weights[k]);
+    }
+}
+
+
+
 
-    PetriNet net = loadFromJSON(inputFile); // Wczytuje sieć Petriego z pliku.
+// Sieci bezpieczne (1-ograniczone): oznakowanie to wektor bitów upakowany w słowa 64-bitowe,
+// a Pre i Post każdego przejścia to maski bitowe tej samej długości.
+using PackedMarking = vector<uint64_t>;
 
-    auto [resultMatrix, mappings] = unfolding(net); // Przeprowadza unfolding i otrzymuje wynikową macierz i mapowania.
-    auto [resultPlaces, resultTransitions] = mappings; // Rozpakowuje mapowania miejsc i przejść.
+struct SafeNet {
+    size_t words = 0;             // Liczba słów na oznakowanie (ceil(miejsca / 64)).
+    vector<uint64_t> preMasks;    // Maska Pre przejścia t zajmuje słowa [t * words, (t + 1) * words).
+    vector<uint64_t> postMasks;   // Maska Post w tym samym układzie.
 
-    saveToJSON(outputFile, resultMatrix, resultPlaces, resultTransitions); // Zapisuje wynik do pliku JSON.
+    const uint64_t* preOf(size_t t) const { return preMasks.data() + t * words; }
+    const uint64_t* postOf(size_t t) const { return postMasks.data() + t * words; }
+};
 
-    cout << "Algorytm unfolding zakończony. Wynik zapisano do pliku " << outputFile << endl;
+// Zgłaszany, gdy odpalenie przejścia położyłoby drugi token w miejscu (sieć nie jest bezpieczna).
+class UnsafeNetError : public runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
 
+// Tryb bitowy wymaga wag łuków równych 1 i oznakowania początkowego 0/1.
+bool canUseSafeMode(const PetriNet& net) {
+    for (int tokens : net.initialMarking) {
+        if (tokens < 0 || tokens > 1) return false;
+    }
+    for (int weight : net.preSparse.weights) {
+        if (weight != 1) return false;
+    }
+    for (int weight : net.postSparse.weights) {
+        if (weight != 1) return false;
+    }
+    return true;
+}
+
+SafeNet buildSafeNet(const PetriNet& net) {
+    SafeNet safe;
+    safe.words = (net.places.size() + 63) / 64;
+    safe.preMasks.assign(net.transitions.size() * safe.words, 0);
+    safe.postMasks.assign(net.transitions.size() * safe.words, 0);
+    for (size_t t = 0; t < net.transitions.size(); ++t) {
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            uint32_t p = net.preSparse.places[k];
+            safe.preMasks[t * safe.words + p / 64] |= 1ULL << (p % 64);
+        }
+        for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+            uint32_t p = net.postSparse.places[k];
+            safe.postMasks[t * safe.words + p / 64] |= 1ULL << (p % 64);
+        }
+    }
+    return safe;
+}
+
+PackedMarking packMarking(const Marking& marking) {
+    PackedMarking packed((marking.size() + 63) / 64, 0);
+    for (size_t p = 0; p < marking.size(); ++p) {
+        if (marking[p]) packed[p / 64] |= 1ULL << (p % 64);
+    }
+    return packed;
+}
+
+// Odpalenie w miejscu: m = (m & ~pre) | post, z aktualizacją haszu o zmienione bity. Sprawdzenie
+// odbywa się przed zapisem, więc przy wyjątku oznakowanie i hasz pozostają niezmienione.
+void applyTransitionSafe(const SafeNet& safe, PackedMarking& marking, size_t t, uint64_t& hash) {
+    const uint64_t* pre = safe.preOf(t);
+    const uint64_t* post = safe.postOf(t);
+    for (size_t w = 0; w < safe.words; ++w) {
+        if (marking[w] & ~pre[w] & post[w]) {
+            throw UnsafeNetError("Sieć nie jest bezpieczna: przejście t" + to_string(t + 1) + " tworzy drugi token w miejscu");
+        }
+    }
+    for (size_t w = 0; w < safe.words; ++w) {
+        uint64_t next = (marking[w] & ~pre[w]) | post[w];
+        toggleBitsHashed(hash, w, marking[w] ^ next);
+        marking[w] = next;
+    }
+}
+
+// Cofnięcie odpalenia: przed nim wszystkie bity Pre były ustawione, a bity Post spoza Pre wyzerowane.
+void undoTransitionSafe(const SafeNet& safe, PackedMarking& marking, size_t t, uint64_t& hash) {
+    const uint64_t* pre = safe.preOf(t);
+    const uint64_t* post = safe.postOf(t);
+    for (size_t w = 0; w < safe.words; ++w) {
+        uint64_t previous = (marking[w] & ~post[w]) | pre[w];
+        toggleBitsHashed(hash, w, marking[w] ^ previous);
+        marking[w] = previous;
+    }
+}
+
+// Zbiór aktywnych przejść utrzymywany przyrostowo. Dla każdego przejścia pamiętana jest liczba
+// miejsc wejściowych, w których brakuje tokenów; przejście jest aktywne, gdy ta liczba wynosi 0.
+// Po odpaleniu przejścia aktualizowane są tylko przejścia konsumujące z miejsc, które się zmieniły.
+class EnabledSet {
+public:
+    void reset(const PetriNet& net, const Marking& marking) {
+        size_t transitionCount = net.transitions.size();
+        missing.assign(transitionCount, 0);
+        enabled.words.assign((transitionCount + 63) / 64, 0);
+        for (size_t t = 0; t < transitionCount; ++t) {
+            for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+                if (marking[net.preSparse.places[k]] < net.preSparse.weights[k]) {
+                    missing[t]++;
+                }
+            }
+            if (missing[t] == 0) {
+                enabled.set(t);
+            }
+        }
+    }
+
+    // Pierwsze aktywne przejście o indeksie >= from (SIZE_MAX, gdy brak).
+    size_t next(size_t from) const { return enabled.findNext(from); }
+
+    // Odpala t w miejscu (marking += Post - Pre) i aktualizuje zbiór oraz hasz dla zmienionych miejsc.
+    void apply(const PetriNet& net, Marking& marking, uint64_t& hash, size_t t) {
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            addTokens(net, marking, hash, net.preSparse.places[k], -net.preSparse.weights[k]);
+        }
+        for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+            addTokens(net, marking, hash, net.postSparse.places[k], net.postSparse.weights[k]);
+        }
+    }
+
+    // Cofa odpalenie t (marking += Pre - Post), przywracając poprzedni stan zbioru i hasz.
+    void undo(const PetriNet& net, Marking& marking, uint64_t& hash, size_t t) {
+        for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+            addTokens(net, marking, hash, net.postSparse.places[k], -net.postSparse.weights[k]);
+        }
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            addTokens(net, marking, hash, net.preSparse.places[k], net.preSparse.weights[k]);
+        }
+    }
+
+private:
+    vector<uint32_t> missing;     // Liczba niespełnionych miejsc wejściowych każdego przejścia.
+    Bitset enabled;               // Przejścia z missing == 0.
+
+    void addTokens(const PetriNet& net, Marking& marking, uint64_t& hash, uint32_t p, int delta) {
+        int oldTokens = marking[p];
+        addTokensHashed(marking, hash, p, delta);
+        placeChanged(net, p, oldTokens, marking[p]);
+    }
+
+    void placeChanged(const PetriNet& net, uint32_t p, int oldTokens, int newTokens) {
+        if (oldTokens == newTokens) {
+            return;
+        }
+        for (uint32_t k = net.consumerOffsets[p]; k < net.consumerOffsets[p + 1]; ++k) {
+            uint32_t t = net.consumers[k];
+            bool wasSatisfied = oldTokens >= net.consumerWeights[k];
+            bool isSatisfied = newTokens >= net.consumerWeights[k];
+            if (wasSatisfied == isSatisfied) {
+                continue;
+            }
+            if (isSatisfied) {
+                missing[t]--;
+            } else {
+                missing[t]++;
+            }
+            if (missing[t] == 0) {
+                enabled.set(t);
+            } else {
+                enabled.reset(t);
+            }
+        }
+    }
+};
+
+// Zbiór aktywnych przejść sieci bezpiecznej. Wszystkie wagi są równe 1, więc przejście jest aktywne,
+// gdy żadne miejsce jego Pre nie jest puste: (pre & ~m) == 0. Odpalenie opróżnia tylko miejsca
+// Pre \ Post i zapełnia tylko miejsca Post \ Pre, więc aktualizowani są wyłącznie ich konsumenci.
+class SafeEnabledSet {
+public:
+    void reset(const PetriNet& net, const SafeNet& safe, const uint64_t* marking) {
+        size_t transitionCount = net.transitions.size();
+        missing.assign(transitionCount, 0);
+        enabled.words.assign((transitionCount + 63) / 64, 0);
+        for (size_t t = 0; t < transitionCount; ++t) {
+            const uint64_t* pre = safe.preOf(t);
+            for (size_t w = 0; w < safe.words; ++w) {
+                missing[t] += static_cast<uint32_t>(__builtin_popcountll(pre[w] & ~marking[w]));
+            }
+            if (missing[t] == 0) {
+                enabled.set(t);
+            }
+        }
+    }
+
+    // Pierwsze aktywne przejście o indeksie >= from (SIZE_MAX, gdy brak).
+    size_t next(size_t from) const { return enabled.findNext(from); }
+
+    // Aktualizuje zbiór po odpaleniu t (fired = true) albo po jego cofnięciu (fired = false).
+    void update(const PetriNet& net, const SafeNet& safe, size_t t, bool fired) {
+        const uint64_t* pre = safe.preOf(t);
+        const uint64_t* post = safe.postOf(t);
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            uint32_t p = net.preSparse.places[k];
+            if (!((post[p / 64] >> (p % 64)) & 1ULL)) {
+                placeChanged(net, p, !fired);
+            }
+        }
+        for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+            uint32_t p = net.postSparse.places[k];
+            if (!((pre[p / 64] >> (p % 64)) & 1ULL)) {
+                placeChanged(net, p, fired);
+            }
+        }
+    }
+
+private:
+    vector<uint32_t> missing;     // Liczba pustych miejsc wejściowych każdego przejścia.
+    Bitset enabled;               // Przejścia z missing == 0.
+
+    void placeChanged(const PetriNet& net, uint32_t p, bool marked) {
+        for (uint32_t k = net.consumerOffsets[p]; k < net.consumerOffsets[p + 1]; ++k) {
+            uint32_t t = net.consumers[k];
+            if (marked) {
+                if (--missing[t] == 0) enabled.set(t);
+            } else {
+                if (missing[t]++ == 0) enabled.reset(t);
+            }
+        }
+    }
+};
+
+// Macierz wynikowa budowana kolumnami. Niezerowe wpisy kolejnych kolumn (wiersz, wartość) trafiają
+// do jednego płaskiego bufora, więc dodanie kolumny nie dotyka pozostałych wierszy. Gęsta macierz
+// (albo wiersze w postaci rzadkiej) powstaje raz, przy zapisie wyniku.
+class ResultMatrixBuilder {
+public:
+    struct Entry {
+        uint32_t row;
+        int value;
+    };
+
+    // Kolumna przejścia: różnica nowego i poprzedniego oznakowania. Pierwsza kolumna ustala
+    // liczbę wierszy równą liczbie miejsc.
+    void addColumn(const Marking& newMarking, const int* previousMarking) {
+        if (columnOffsets.size() == 1) {
+            rowCount = newMarking.size();
+        }
+        for (size_t i = 0; i < newMarking.size(); ++i) {
+            if (newMarking[i] != previousMarking[i]) {
+                entries.push_back({static_cast<uint32_t>(i), newMarking[i] - previousMarking[i]});
+            }
+        }
+        columnOffsets.push_back(entries.size());
+        STATS_ADD(columnsAdded, 1);
+    }
+
+    // Kolumna przejścia prowadzącego do odwiedzonego już oznakowania: dodatnie wpisy są przenoszone
+    // z wierszy miejsc do nowych wierszy (kopii miejsc), które poza tą kolumną mają same zera.
+    void addCycleColumn(const Marking& newMarking, const int* previousMarking) {
+        if (columnOffsets.size() == 1) {
+            rowCount = newMarking.size();
+        }
+        for (size_t i = 0; i < newMarking.size(); ++i) {
+            int difference = newMarking[i] - previousMarking[i];
+            if (difference > 0) {
+                entries.push_back({static_cast<uint32_t>(rowCount++), difference});
+                STATS_ADD(rowsAdded, 1);
+            } else if (difference < 0) {
+                entries.push_back({static_cast<uint32_t>(i), difference});
+            }
+        }
+        columnOffsets.push_back(entries.size());
+        STATS_ADD(cycleColumnsAdded, 1);
+    }
+
+    // Kolumna oznakowań upakowanych bitowo (sieci bezpieczne, liczba miejsc placeCount). Zmienione
+    // miejsca to bity newMarking ^ previousMarking, więc oznakowań nie trzeba rozpakowywać; cycle
+    // oznacza kolumnę przejścia do odwiedzonego oznakowania, jak w addCycleColumn.
+    void addPackedColumn(const uint64_t* newMarking, const uint64_t* previousMarking, size_t words, size_t placeCount, bool cycle) {
+        if (columnOffsets.size() == 1) {
+            rowCount = placeCount;
+        }
+        for (size_t w = 0; w < words; ++w) {
+            for (uint64_t changed = newMarking[w] ^ previousMarking[w]; changed; changed &= changed - 1) {
+                uint32_t p = static_cast<uint32_t>(w * 64 + __builtin_ctzll(changed));
+                bool gained = (newMarking[w] >> (p % 64)) & 1ULL;
+                if (gained && cycle) {
+                    entries.push_back({static_cast<uint32_t>(rowCount++), 1});
+                    STATS_ADD(rowsAdded, 1);
+                } else {
+                    entries.push_back({p, gained ? 1 : -1});
+                }
+            }
+        }
+        columnOffsets.push_back(entries.size());
+        if (cycle) {
+            STATS_ADD(cycleColumnsAdded, 1);
+        } else {
+            STATS_ADD(columnsAdded, 1);
+        }
+    }
+
+    size_t rows() const { return rowCount; }
+    size_t columns() const { return columnOffsets.size() - 1; }
+
+    // Wiersze w postaci rzadkiej (CSR): wpisy wiersza r to rowEntries[rowOffsets[r]..rowOffsets[r + 1]),
+    // z numerem kolumny w polu row. Kolumny w obrębie wiersza są rosnące.
+    void toRows(vector<size_t>& rowOffsets, vector<Entry>& rowEntries) const {
+        rowOffsets.assign(rowCount + 1, 0);
+        for (const Entry& entry : entries) {
+            rowOffsets[entry.row + 1]++;
+        }
+        for (size_t r = 0; r < rowCount; ++r) {
+            rowOffsets[r + 1] += rowOffsets[r];
+        }
+        rowEntries.resize(entries.size());
+        vector<size_t> fill(rowOffsets.begin(), rowOffsets.end() - 1);
+        for (size_t c = 0; c + 1 < columnOffsets.size(); ++c) {
+            for (size_t k = columnOffsets[c]; k < columnOffsets[c + 1]; ++k) {
+                rowEntries[fill[entries[k].row]++] = {static_cast<uint32_t>(c), entries[k].value};
+            }
+        }
+    }
+
+private:
+    size_t rowCount = 0;
+    vector<size_t> columnOffsets = {0}; // Kolumna c zajmuje entries[columnOffsets[c]..columnOffsets[c + 1]).
+    vector<Entry> entries;
+};
+
+// Zapisuje wynik strumieniowo, wiersz po wierszu (compact = bez wcięć). Gęsty wiersz jest odtwarzany
+// z postaci rzadkiej w jednym buforze, więc cała gęsta macierz nigdy nie jest w pamięci.
+void saveToJSON(const string& filename, const ResultMatrixBuilder& matrix, const vector<string>& places, const vector<string>& transitions, bool compact = false) {
+    STATS_TIMER(save);
+    vector<size_t> rowOffsets;
+    vector<ResultMatrixBuilder::Entry> rowEntries;
+    matrix.toRows(rowOffsets, rowEntries);
+
+    JsonStreamWriter writer(filename, compact);
+    writer.beginObject();
+    writer.key("Place");          // Miejsca.
+    writer.stringArray(places);
+    writer.key("Transition");     // Przejścia.
+    writer.stringArray(transitions);
+    writer.key("matrix");         // Macierz wynikowa.
+    writer.beginArray();
+    vector<int> row(matrix.columns(), 0);
+    for (size_t r = 0; r < matrix.rows(); ++r) {
+        for (size_t k = rowOffsets[r]; k < rowOffsets[r + 1]; ++k) row[rowEntries[k].row] = rowEntries[k].value;
+        writer.numberArray(row.data(), row.size());
+        for (size_t k = rowOffsets[r]; k < rowOffsets[r + 1]; ++k) row[rowEntries[k].row] = 0;
+    }
+    writer.endArray();
+    writer.endObject();
+    writer.close();
+}
+
+// Przestrzeń stanów z oznakowaniami ogólnymi. Jedno oznakowanie robocze jest modyfikowane w miejscu
+// (apply/undo), a zbiór aktywnych przejść aktualizowany przyrostowo.
+struct GeneralStateSpace {
+    using Store = MarkingStore;
+
+    const PetriNet& net;
+    Marking working;
+    uint64_t hash;                // Hasz Zobrista oznakowania roboczego, aktualizowany przy apply/undo.
+    EnabledSet enabled;
+
+    explicit GeneralStateSpace(const PetriNet& net)
+        : net(net), working(net.initialMarking), hash(Store::hashMarking(working)) {
+        enabled.reset(net, working);
+    }
+
+    const Marking& current() const { return working; }
+    uint64_t currentHash() const { return hash; }
+    void load(const int* marking, uint64_t markingHash) {
+        working.assign(marking, marking + working.size());
+        hash = markingHash;
+        enabled.reset(net, working);
+    }
+    size_t nextEnabled(size_t from) const {
+        size_t t = enabled.next(from);
+        STATS_ADD(transitionsTested, (t < net.transitions.size() ? t + 1 : net.transitions.size()) - from); // Pominięte przez zbiór też się liczą.
+        STATS_ADD(transitionsEnabled, t < net.transitions.size() ? 1 : 0);
+        return t;
+    }
+    void apply(size_t t) { enabled.apply(net, working, hash, t); }
+    void undo(size_t t) { enabled.undo(net, working, hash, t); }
+
+    void addColumn(ResultMatrixBuilder& matrix, const Store& markingHistory, uint32_t previousId, bool duplicate) {
+        if (duplicate) {
+            matrix.addCycleColumn(working, markingHistory.marking(previousId));
+        } else {
+            matrix.addColumn(working, markingHistory.marking(previousId));
+        }
+    }
+};
+
+// Przestrzeń stanów sieci bezpiecznej: oznakowania upakowane bitowo, a zbiór aktywnych przejść
+// aktualizowany przyrostowo z masek. Kolumny wyniku liczone są wprost z bitów, bez rozpakowywania.
+struct SafeStateSpace {
+    using Store = PackedMarkingStore;
+
+    const PetriNet& net;
+    SafeNet safe;
+    PackedMarking working;
+    uint64_t hash;
+    SafeEnabledSet enabled;
+
+    explicit SafeStateSpace(const PetriNet& net)
+        : net(net), safe(buildSafeNet(net)), working(packMarking(net.initialMarking)), hash(Store::hashMarking(working)) {
+        enabled.reset(net, safe, working.data());
+    }
+
+    const PackedMarking& current() const { return working; }
+    uint64_t currentHash() const { return hash; }
+    void load(const uint64_t* marking, uint64_t markingHash) {
+        working.assign(marking, marking + safe.words);
+        hash = markingHash;
+        enabled.reset(net, safe, working.data());
+    }
+    size_t nextEnabled(size_t from) const {
+        size_t t = enabled.next(from);
+        STATS_ADD(transitionsTested, (t < net.transitions.size() ? t + 1 : net.transitions.size()) - from);
+        STATS_ADD(transitionsEnabled, t < net.transitions.size() ? 1 : 0);
+        return t;
+    }
+    void apply(size_t t) {
+        applyTransitionSafe(safe, working, t, hash); // Przy wyjątku zbiór pozostaje zgodny z oznakowaniem.
+        enabled.update(net, safe, t, true);
+    }
+    void undo(size_t t) {
+        undoTransitionSafe(safe, working, t, hash);
+        enabled.update(net, safe, t, false);
+    }
+
+    void addColumn(ResultMatrixBuilder& matrix, const Store& markingHistory, uint32_t previousId, bool duplicate) {
+        matrix.addPackedColumn(working.data(), markingHistory.marking(previousId), safe.words, net.places.size(), duplicate);
+    }
+};
+
+enum class SearchOrder {
+    DFS,                          // W głąb (stos): kolejność kolumn jak w pierwotnej wersji rekurencyjnej.
+    BFS                           // Wszerz (kolejka): oznakowanie ramki odtwarzane z historii.
+};
+
+struct ExplorationOptions {
+    SearchOrder order = SearchOrder::DFS;
+    size_t maxStates = 0;         // Limit liczby odwiedzonych oznakowań (0 = bez limitu).
+    size_t maxFrontier = 0;       // Limit liczby ramek na stosie / w kolejce (0 = bez limitu).
+    size_t maxMemoryBytes = 0;    // Limit przybliżonej pamięci historii i ramek (0 = bez limitu).
+};
+
+struct ExplorationStats {
+    size_t states = 0;            // Odwiedzone oznakowania.
+    size_t firings = 0;           // Odpalone przejścia (krawędzie grafu osiągalności).
+    size_t peakFrontier = 0;      // Największa liczba ramek naraz.
+    bool truncated = false;       // Czy przerwano po przekroczeniu któregoś limitu.
+};
+
+// Ramka przeszukiwania: id oznakowania i pierwsze przejście do sprawdzenia. W DFS przejście, którym
+// przyszliśmy do ramki, to nextTransition - 1 ramki poprzedniej, więc nie trzeba go zapamiętywać.
+struct SearchFrame {
+    uint32_t markingId;
+    uint32_t nextTransition;
+};
+
+// Przeszukiwanie z jawnym stosem (DFS) albo kolejką (BFS) zamiast rekurencji, więc głębokość nie
+// jest ograniczona stosem wywołań. Jak w wersji rekurencyjnej następnik oznakowania osiągniętego przez
+// t rozważa tylko przejścia o indeksach > t, a kolumna liczona jest względem ostatnio dodanego oznakowania.
+template <typename Space>
+ExplorationStats exploreStateSpace(Space& space, typename Space::Store& markingHistory, ResultMatrixBuilder& resultMatrix, const ExplorationOptions& options) {
+    STATS_TIMER(explore);
+    const size_t transitionCount = space.net.transitions.size();
+    ExplorationStats stats;
+    deque<SearchFrame> frontier;
+
+    auto limitReached = [&]() {
+        if (options.maxStates && markingHistory.size() >= options.maxStates) {
+            return true;
+        }
+        if (options.maxFrontier && frontier.size() >= options.maxFrontier) {
+            return true;
+        }
+        return options.maxMemoryBytes
+            && markingHistory.memoryUsage() + frontier.size() * sizeof(SearchFrame) > options.maxMemoryBytes;
+    };
+
+    // Odpala t w bieżącym oznakowaniu, dopisuje kolumnę i zwraca id nowego oznakowania
+    // (EMPTY_SLOT, jeśli było już odwiedzone).
+    auto fire = [&](size_t t) {
+        uint32_t lastId = static_cast<uint32_t>(markingHistory.size() - 1);
+        space.apply(t);
+        stats.firings++;
+        auto [id, isNew] = markingHistory.insert(space.current(), space.currentHash());
+        STATS_ADD(markingsVisited, isNew ? 1 : 0);
+        STATS_ADD(duplicatesHit, isNew ? 0 : 1);
+        space.addColumn(resultMatrix, markingHistory, lastId, !isNew);
+        return isNew ? id : Space::Store::EMPTY_SLOT;
+    };
+
+    markingHistory.insert(space.current(), space.currentHash());
+    frontier.push_back({0, 0});
+    size_t level = 1;          // BFS: głębokość warstwy, z której pochodzi ramka z przodu kolejki.
+    size_t levelRemaining = 1; // BFS: ramki tej warstwy, które są jeszcze w kolejce.
+
+    while (!frontier.empty() && !stats.truncated) {
+        stats.peakFrontier = max(stats.peakFrontier, frontier.size());
+
+        if (options.order == SearchOrder::DFS) {
+            SearchFrame& top = frontier.back();
+            size_t t = space.nextEnabled(top.nextTransition);
+            if (t >= transitionCount) {
+                frontier.pop_back();
+                if (!frontier.empty()) {
+                    space.undo(frontier.back().nextTransition - 1); // Powrót do oznakowania rodzica.
+                }
+                continue;
+            }
+            if (limitReached()) {
+                stats.truncated = true;
+                break;
+            }
+            top.nextTransition = static_cast<uint32_t>(t + 1);
+            uint32_t id = fire(t);
+            if (id == Space::Store::EMPTY_SLOT) {
+                space.undo(t);
+            } else {
+                frontier.push_back({id, static_cast<uint32_t>(t + 1)});
+                STATS_MAX(maxDepth, frontier.size());
+            }
+        } else {
+            SearchFrame frame = frontier.front();
+            frontier.pop_front();
+            space.load(markingHistory.marking(frame.markingId), markingHistory.hashOf(frame.markingId));
+            for (size_t t = space.nextEnabled(frame.nextTransition); t < transitionCount; t = space.nextEnabled(t + 1)) {
+                if (limitReached()) {
+                    stats.truncated = true;
+                    break;
+                }
+                uint32_t id = fire(t);
+                if (id != Space::Store::EMPTY_SLOT) {
+                    frontier.push_back({id, static_cast<uint32_t>(t + 1)});
+                    STATS_MAX(maxDepth, level + 1);
+                }
+                space.undo(t);
+            }
+            if (--levelRemaining == 0) {
+                level++;
+                levelRemaining = frontier.size();
+            }
+        }
+    }
+
+    stats.states = markingHistory.size();
+    return stats;
+}
+
+pair<ResultMatrixBuilder, pair<vector<string>, vector<string>>> unfolding(const PetriNet& net, MarkingStore& markingHistory, const ExplorationOptions& options, ExplorationStats& stats) {
+    ResultMatrixBuilder resultMatrix; // Początkowo pusta macierz wynikowa.
+    vector<string> resultPlaces; // Początkowo pusta lista miejsc.
+    vector<string> resultTransitions; // Początkowo pusta lista przejść.
+
+    GeneralStateSpace space(net);
+    stats = exploreStateSpace(space, markingHistory, resultMatrix, options);
+
+    return {resultMatrix, {resultPlaces, resultTransitions}}; // Zwraca macierz wynikową i odpowiadające listy.
+}
+
+// ---------------------------------------------------------------------------
+// Rozwinięcie sieci (branching process) według McMillana: warunki, zdarzenia,
+// możliwe rozszerzenia, konfiguracje lokalne i zdarzenia odcinające (cutoff).
+// ---------------------------------------------------------------------------
+
+// Warunek prefiksu: pojedynczy token w miejscu sieci.
+struct Condition {
+    uint32_t place;               // Miejsce sieci, którym etykietowany jest warunek.
+    int preEvent;                 // Zdarzenie, które wytworzyło warunek (-1 dla warunków początkowych).
+    vector<uint32_t> postEvents;  // Zdarzenia konsumujące warunek (więcej niż jedno oznacza konflikt).
+};
+
+// Zdarzenie prefiksu: wystąpienie przejścia sieci.
+struct Event {
+    uint32_t transition;          // Przejście sieci, którym etykietowane jest zdarzenie.
+    vector<uint32_t> preset;      // Warunki wejściowe.
+    vector<uint32_t> postset;     // Warunki wyjściowe.
+    Bitset localConfig;           // Konfiguracja lokalna [e] (zbiór zdarzeń, łącznie z e).
+    uint32_t localSize = 0;       // |[e]|
+    uint32_t depth = 0;           // Poziom w postaci normalnej Foaty (1 + maksymalny poziom poprzedników).
+    uint32_t markingId = 0;       // Id oznakowania Mark([e]) w tablicy odcięć.
+    bool cutoff = false;          // Czy zdarzenie jest odcinające.
+    int companion = -1;           // Zdarzenie o tym samym oznakowaniu i mniejszej konfiguracji (-1 = oznakowanie początkowe).
+};
+
+// Skończony kompletny prefiks rozwinięcia.
+struct Prefix {
+    vector<Condition> conditions;
+    vector<Event> events;
+    size_t initialConditions = 0; // Warunki 0..initialConditions-1 tworzą Min (oznakowanie początkowe).
+    size_t cutoffCount = 0;       // Liczba zdarzeń odcinających.
+    bool truncated = false;       // Czy budowa została przerwana limitem zdarzeń.
+    bool unsafe = false;          // Czy któreś oznakowanie prefiksu ma co najmniej 2 tokeny w miejscu.
+
+    // Statystyki kolejki możliwych rozszerzeń.
+    size_t peakQueueSize = 0;     // Największa liczba rozszerzeń oczekujących w kolejce.
+    size_t queueComparisons = 0;  // Liczba porównań wykonanych przez kopiec.
+    size_t foataComputations = 0; // Ile razy trzeba było wyznaczyć postać normalną Foaty.
+
+    // Statystyki równoległego wyszukiwania rozszerzeń.
+    size_t threads = 1;
+    size_t extensionTasks = 0;    // Zadania (warunek, przejście) wykonane przez pulę.
+    size_t stolenTasks = 0;       // Zadania wykonane przez inny wątek niż ten, któremu je przydzielono.
+};
+
+// Porządek adekwatny używany do wyboru rozszerzeń i wykrywania odcięć.
+enum class AdequateOrder {
+    McMillan,                     // |[e]| (porządek częściowy z pracy McMillana).
+    ERV                           // Porządek totalny Esparzy-Römera-Voglera: rozmiar, wektor Parikha, postać Foaty.
+};
+// Porządek ERV jest totalny tylko dla sieci bezpiecznych i tylko wtedy liczba zdarzeń nieodcinających
+// nie przekracza liczby osiągalnych oznakowań. W sieci nie-1-ograniczonej zdarzenia różniące się tylko
+// tym, który z kilku tokenów tego samego miejsca zużywają, mają równe klucze i żadne z nich nie jest
+// odcinające; prefiks pozostaje kompletny, ale może być znacznie większy.
+
+struct UnfoldingOptions {
+    size_t maxEvents = 0;         // Limit liczby zdarzeń (0 = bez limitu; sieci nieograniczone się nie kończą).
+    AdequateOrder order = AdequateOrder::ERV;
+    size_t threads = 1;           // Liczba wątków wyszukujących rozszerzenia (0 = liczba rdzeni).
+};
+
+// Wektor Parikha w postaci rzadkiej: posortowane pary (przejście, liczba wystąpień).
+using Parikh = vector<pair<uint32_t, uint32_t>>;
+
+// Klucz konfiguracji dla porządku adekwatnego.
+struct ConfigKey {
+    uint32_t size = 0;            // |C|
+    Parikh parikh;                // Wektor Parikha konfiguracji (tylko dla porządku ERV).
+    vector<Parikh> foata;         // Wektory Parikha kolejnych poziomów postaci normalnej Foaty (liczone leniwie).
+    bool foataReady = false;      // Czy pole foata zostało już wyznaczone.
+};
+
+// Porównanie leksykograficzne względem kolejności przejść: wygrywa mniejsza liczba wystąpień
+// pierwszego przejścia, na którym wektory się różnią.
+int compareParikh(const Parikh& a, const Parikh& b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        uint32_t ta = i < a.size() ? a[i].first : UINT32_MAX;
+        uint32_t tb = j < b.size() ? b[j].first : UINT32_MAX;
+        if (ta == tb) {
+            if (a[i].second != b[j].second) {
+                return a[i].second < b[j].second ? -1 : 1;
+            }
+            ++i;
+            ++j;
+        } else {
+            return ta < tb ? 1 : -1; // Przejście występuje tylko w jednym z wektorów.
+        }
+    }
+    return 0;
+}
+
+// Porównuje rozmiar i wektor Parikha (-1, 0 albo 1). Wynik 0 w porządku ERV oznacza, że o kolejności
+// decyduje dopiero postać Foaty.
+int compareSizeAndParikh(const ConfigKey& a, const ConfigKey& b, AdequateOrder order) {
+    if (a.size != b.size) {
+        return a.size < b.size ? -1 : 1;
+    }
+    if (order == AdequateOrder::McMillan) {
+        return 0;
+    }
+    return compareParikh(a.parikh, b.parikh);
+}
+
+// Porównanie postaci normalnych Foaty poziom po poziomie (oba klucze muszą mieć foataReady).
+int compareFoata(const ConfigKey& a, const ConfigKey& b) {
+    for (size_t level = 0; level < a.foata.size() && level < b.foata.size(); ++level) {
+        if (int c = compareParikh(a.foata[level], b.foata[level])) {
+            return c;
+        }
+    }
+    if (a.foata.size() != b.foata.size()) {
+        return a.foata.size() < b.foata.size() ? -1 : 1;
+    }
+    return 0;
+}
+
+// Kopiec d-arny: płytszy od binarnego, więc pobranie minimum wymaga mniej poziomów i lepiej korzysta
+// z pamięci podręcznej. Kopiec przesuwa tylko indeksy do puli elementów, a nie same (duże) elementy.
+// Before(a, b) zwraca true, gdy a ma zostać pobrane przed b; może leniwie uzupełniać klucze elementów.
+template <typename T, typename Before, size_t D = 4>
+class DaryHeap {
+public:
+    struct Stats {
+        size_t pushes = 0;
+        size_t pops = 0;
+        size_t comparisons = 0;
+        size_t peakSize = 0;
+    };
+
+    explicit DaryHeap(Before before) : before(before) {}
+
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+    const Stats& statistics() const { return stats; }
+
+    void push(T&& item) {
+        uint32_t slot;
+        if (freeSlots.empty()) {
+            slot = static_cast<uint32_t>(pool.size());
+            pool.push_back(move(item));
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            pool[slot] = move(item);
+        }
+        heap.push_back(slot);
+        siftUp(heap.size() - 1);
+        stats.pushes++;
+        stats.peakSize = max(stats.peakSize, heap.size());
+    }
+
+    T pop() {
+        uint32_t top = heap.front();
+        heap.front() = heap.back();
+        heap.pop_back();
+        if (!heap.empty()) {
+            siftDown(0);
+        }
+        T item = move(pool[top]);
+        freeSlots.push_back(top);
+        stats.pops++;
+        return item;
+    }
+
+private:
+    Before before;
+    vector<T> pool;               // Elementy (sloty z freeSlots są wolne).
+    vector<uint32_t> freeSlots;
+    vector<uint32_t> heap;        // Indeksy do puli w porządku kopca.
+    Stats stats;
+
+    bool less(uint32_t a, uint32_t b) {
+        stats.comparisons++;
+        return before(pool[a], pool[b]);
+    }
+
+    void siftUp(size_t i) {
+        uint32_t slot = heap[i];
+        while (i > 0) {
+            size_t parent = (i - 1) / D;
+            if (!less(slot, heap[parent])) break;
+            heap[i] = heap[parent];
+            i = parent;
+        }
+        heap[i] = slot;
+    }
+
+    void siftDown(size_t i) {
+        uint32_t slot = heap[i];
+        while (true) {
+            size_t first = i * D + 1;
+            if (first >= heap.size()) break;
+            size_t best = first;
+            size_t last = min(first + D, heap.size());
+            for (size_t child = first + 1; child < last; ++child) {
+                if (less(heap[child], heap[best])) best = child;
+            }
+            if (!less(heap[best], slot)) break;
+            heap[i] = heap[best];
+            i = best;
+        }
+        heap[i] = slot;
+    }
+};
+
+// Zamienia listę przejść na rzadki wektor Parikha.
+Parikh toParikh(vector<uint32_t>& transitions) {
+    sort(transitions.begin(), transitions.end());
+    Parikh parikh;
+    for (uint32_t t : transitions) {
+        if (!parikh.empty() && parikh.back().first == t) {
+            parikh.back().second++;
+        } else {
+            parikh.push_back({t, 1});
+        }
+    }
+    return parikh;
+}
+
+// Liczba wątków dla opcji --threads: 0 oznacza liczbę rdzeni.
+size_t resolveThreadCount(size_t requested) {
+    return requested ? requested : max(1u, thread::hardware_concurrency());
+}
+
+// Pula wątków z kradzieżą zadań. Każdy wątek ma własną kolejkę: pobiera zadania z jej końca,
+// a gdy jest pusta, kradnie z początku kolejki innego wątku. Wątek wywołujący parallelFor
+// pracuje jako wątek nr 0, więc pula z jednym wątkiem nie tworzy żadnych dodatkowych wątków.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t threadCount) {
+        threadCount = max<size_t>(threadCount, 1);
+        for (size_t i = 0; i < threadCount; ++i) {
+            queues.push_back(make_unique<WorkerQueue>());
+        }
+        for (size_t i = 1; i < threadCount; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> guard(stateLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t threadCount() const { return queues.size(); }
+    size_t executedTasks() const { return executed.load(); }
+    size_t stolenTasks() const { return stolen.load(); }
+
+    // Wykonuje body(i) dla i z zakresu [0, count) i czeka na zakończenie wszystkich zadań.
+    void parallelFor(size_t count, const function<void(size_t)>& body) {
+        if (count == 0) {
+            return;
+        }
+
+        // Zadanie ustawia się przed wstawieniem zadań: wątek, który jeszcze nie wrócił do czekania
+        // po poprzedniej porcji, może pobrać nowe zadanie przed podbiciem numeru porcji.
+        {
+            lock_guard<mutex> guard(stateLock);
+            currentBody = &body;
+            remaining = count;
+        }
+        // Zadania są rozdzielane ciągłymi blokami, żeby sąsiednie zadania trafiały do tego samego wątku.
+        size_t threads = queues.size();
+        for (size_t q = 0; q < threads; ++q) {
+            lock_guard<mutex> guard(queues[q]->lock);
+            for (size_t i = count * q / threads; i < count * (q + 1) / threads; ++i) {
+                queues[q]->tasks.push_back(i);
+            }
+        }
+        {
+            lock_guard<mutex> guard(stateLock);
+            generation++;
+        }
+        wake.notify_all();
+
+        while (runOne(0)) {
+        }
+        unique_lock<mutex> lock(stateLock);
+        done.wait(lock, [this] { return remaining == 0; });
+        currentBody = nullptr;
+    }
+
+private:
+    struct WorkerQueue {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues; // Kolejka 0 należy do wątku wywołującego.
+    vector<thread> workers;
+    mutex stateLock;
+    condition_variable wake;      // Budzi wątki przy nowej porcji zadań albo zamykaniu puli.
+    condition_variable done;      // Sygnalizuje wykonanie ostatniego zadania porcji.
+    const function<void(size_t)>* currentBody = nullptr;
+    size_t remaining = 0;         // Zadania porcji jeszcze niewykonane (chronione przez stateLock).
+    size_t generation = 0;        // Numer porcji zadań.
+    bool stopping = false;
+    atomic<size_t> executed{0};
+    atomic<size_t> stolen{0};
+
+    // Pobiera zadanie z własnej kolejki albo kradnie z cudzej; zwraca false, gdy nie ma już zadań.
+    bool runOne(size_t self) {
+        size_t task = 0;
+        bool found = false;
+        {
+            WorkerQueue& own = *queues[self];
+            lock_guard<mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                found = true;
+            }
+        }
+        for (size_t k = 1; !found && k < queues.size(); ++k) {
+            WorkerQueue& victim = *queues[(self + k) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                found = true;
+                stolen++;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+
+        (*currentBody)(task);
+        executed++;
+        lock_guard<mutex> guard(stateLock);
+        if (--remaining == 0) {
+            done.notify_all();
+        }
+        return true;
+    }
+
+    void workerLoop(size_t self) {
+        size_t seenGeneration = 0;
+        while (true) {
+            {
+                unique_lock<mutex> lock(stateLock);
+                wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) {
+                    return;
+                }
+                seenGeneration = generation;
+            }
+            while (runOne(self)) {
+            }
+        }
+    }
+};
+
+class Unfolder {
+public:
+    Unfolder(const PetriNet& net, const UnfoldingOptions& options)
+        : net(net), options(options),
+          pool(resolveThreadCount(options.threads)) {}
+
+    Prefix run() {
+        conditionsOfPlace.assign(net.places.size(), {});
+
+        // Warunki początkowe: po jednym na każdy token oznakowania początkowego.
+        for (size_t p = 0; p < net.initialMarking.size(); ++p) {
+            for (int k = 0; k < net.initialMarking[p]; ++k) {
+                addCondition(static_cast<uint32_t>(p), -1);
+            }
+        }
+        prefix.initialConditions = prefix.conditions.size();
+        prefix.unsafe = any_of(net.initialMarking.begin(), net.initialMarking.end(), [](int tokens) { return tokens > 1; });
+
+        // Warunki początkowe są parami współbieżne.
+        for (uint32_t c = 0; c < prefix.initialConditions; ++c) {
+            for (uint32_t d = 0; d < prefix.initialConditions; ++d) {
+                if (c != d) co[c].set(d);
+            }
+        }
+
+        // Oznakowanie początkowe odpowiada pustej konfiguracji (zdarzenie "bottom").
+        initialHash = MarkingStore::hashMarking(net.initialMarking);
+        cutoffMarkings.insert(net.initialMarking, initialHash);
+        firstEventOfMarking.push_back(-1);
+
+        findExtensions(-1);
+
+        while (!queue.empty()) {
+            if (options.maxEvents && prefix.events.size() >= options.maxEvents) {
+                prefix.truncated = true;
+                break;
+            }
+
+            uint32_t e = addEvent(queue.pop());
+            if (!prefix.events[e].cutoff) {
+                findExtensions(static_cast<int>(e)); // Zdarzeń odcinających nie rozszerzamy.
+            }
+        }
+
+        prefix.threads = pool.threadCount();
+        prefix.extensionTasks = pool.executedTasks();
+        prefix.stolenTasks = pool.stolenTasks();
+        prefix.peakQueueSize = queue.statistics().peakSize;
+        prefix.queueComparisons = queue.statistics().comparisons;
+        return move(prefix);
+    }
+
+private:
+    // Możliwe rozszerzenie: przejście wraz ze współbieżnym zbiorem warunków wejściowych.
+    struct Extension {
+        uint32_t transition;
+        vector<uint32_t> preset;  // Posortowane id warunków.
+        Bitset history;           // Suma konfiguracji lokalnych producentów warunków (bez samego zdarzenia).
+        uint32_t depth;           // Poziom Foaty nowego zdarzenia.
+        ConfigKey key;            // Klucz konfiguracji [e] dla porządku adekwatnego.
+        uint64_t sequence;        // Kolejność wygenerowania (rozstrzyga remisy deterministycznie).
+    };
+
+    // Komparator kolejki: true, gdy a poprzedza b w porządku adekwatnym (remisy według kolejności generowania).
+    bool extensionBefore(Extension& a, Extension& b) {
+        int c = compareSizeAndParikh(a.key, b.key, options.order);
+        if (c == 0 && options.order == AdequateOrder::ERV) {
+            ensureFoata(a.key, a.history, static_cast<int>(a.transition), a.depth);
+            ensureFoata(b.key, b.history, static_cast<int>(b.transition), b.depth);
+            c = compareFoata(a.key, b.key);
+        }
+        if (c) {
+            return c < 0;
+        }
+        return a.sequence < b.sequence;
+    }
+
+    struct ExtensionBefore {
+        Unfolder* unfolder;
+        bool operator()(Extension& a, Extension& b) const { return unfolder->extensionBefore(a, b); }
+    };
+
+    const PetriNet& net;
+    UnfoldingOptions options;
+    Prefix prefix;
+    DaryHeap<Extension, ExtensionBefore> queue{ExtensionBefore{this}}; // Kolejka możliwych rozszerzeń.
+    uint64_t nextSequence = 0;
+    MarkingStore cutoffMarkings;  // Oznakowania Mark([e]) już obecne w prefiksie.
+    uint64_t initialHash = 0;     // Hasz Zobrista oznakowania początkowego.
+    Marking eventMarking;         // Bufor na Mark([e]) dodawanego zdarzenia; kopię trzyma tylko cutoffMarkings.
+    vector<int> firstEventOfMarking; // Dla każdego oznakowania: zdarzenie o najmniejszej konfiguracji.
+    vector<ConfigKey> eventKeys;  // Klucze konfiguracji lokalnych dodanych zdarzeń.
+    vector<Bitset> co;            // Relacja współbieżności: co[c] to zbiór warunków współbieżnych z c.
+    vector<vector<uint32_t>> conditionsOfPlace; // Indeks: miejsce sieci -> warunki nim etykietowane.
+    WorkStealingPool pool;        // Wątki wyszukujące rozszerzenia.
+
+    uint32_t addCondition(uint32_t place, int preEvent) {
+        uint32_t c = static_cast<uint32_t>(prefix.conditions.size());
+        prefix.conditions.push_back({place, preEvent, {}});
+        co.emplace_back();
+        if (preEvent < 0 || !prefix.events[preEvent].cutoff) {
+            conditionsOfPlace[place].push_back(c); // Warunki zdarzeń odcinających nie są kandydatami.
+        }
+        return c;
+    }
+
+    const Bitset* historyOf(uint32_t c) const {
+        int producer = prefix.conditions[c].preEvent;
+        return producer >= 0 ? &prefix.events[producer].localConfig : nullptr;
+    }
+
+    // Warunki są współbieżne, gdy nie są przyczynowo zależne ani w konflikcie (relacja co).
+    bool areConcurrent(uint32_t a, uint32_t b) const {
+        return co[a].test(b);
+    }
+
+    // Oznakowanie osiągane po konfiguracji: M0 + suma (Post - Pre) po jej zdarzeniach. Hasz Zobrista
+    // liczony jest przy tym od haszu M0, tylko dla zmienianych miejsc. Wynik trafia do bufora marking.
+    void markingOf(const Bitset& config, Marking& marking, uint64_t& hash) const {
+        marking = net.initialMarking;
+        hash = initialHash;
+        config.forEach([&](size_t e) {
+            applyTransition(net, marking, prefix.events[e].transition, hash);
+        });
+    }
+
+    uint32_t addEvent(Extension&& extension) {
+        uint32_t e = static_cast<uint32_t>(prefix.events.size());
+        prefix.events.emplace_back();
+        Event& event = prefix.events.back();
+        event.transition = extension.transition;
+        event.preset = move(extension.preset);
+        event.localConfig = move(extension.history);
+        event.localConfig.set(e);
+        event.localSize = extension.key.size;
+        event.depth = extension.depth;
+        eventKeys.push_back(move(extension.key));
+
+        for (uint32_t c : event.preset) {
+            prefix.conditions[c].postEvents.push_back(e);
+        }
+
+        // Zdarzenie jest odcinające, jeśli jego oznakowanie osiągnięto już mniejszą konfiguracją.
+        uint64_t hash;
+        markingOf(event.localConfig, eventMarking, hash);
+        auto [markingId, isNew] = cutoffMarkings.insert(eventMarking, hash);
+        event.markingId = markingId;
+        if (isNew) {
+            firstEventOfMarking.push_back(static_cast<int>(e));
+            if (!prefix.unsafe) {
+                prefix.unsafe = any_of(eventMarking.begin(), eventMarking.end(), [](int tokens) { return tokens > 1; });
+            }
+        } else {
+            int companion = firstEventOfMarking[markingId];
+            // Konfiguracja pusta (companion = -1) poprzedza każdą inną.
+            if (companion < 0 || compareEventConfigs(static_cast<uint32_t>(companion), e) < 0) {
+                event.cutoff = true;
+                event.companion = companion;
+                prefix.cutoffCount++;
+            }
+        }
+
+        // Warunki wyjściowe: po jednym na każdy token oddawany przez przejście.
+        uint32_t t = event.transition;
+        for (size_t k = net.postSparse.begin(t); k < net.postSparse.end(t); ++k) {
+            for (int w = 0; w < net.postSparse.weights[k]; ++w) {
+                uint32_t c = addCondition(net.postSparse.places[k], static_cast<int>(e));
+                prefix.events[e].postset.push_back(c);
+            }
+        }
+        if (!prefix.events[e].cutoff) {
+            updateConcurrency(e); // Warunki zdarzeń odcinających nigdy nie trafiają do rozszerzeń.
+        }
+        return e;
+    }
+
+    // Przyrostowa aktualizacja relacji co dla warunków wyjściowych zdarzenia e:
+    // co(y) = (iloczyn co(x) po warunkach wejściowych x) + pozostałe warunki wyjściowe e.
+    // Preset zdarzenia nie jest pusty (sieci z przejściami bez presetu odrzuca unfoldingMcMillan).
+    void updateConcurrency(uint32_t e) {
+        const Event& event = prefix.events[e];
+        Bitset common = co[event.preset.front()];
+        for (size_t i = 1; i < event.preset.size(); ++i) {
+            common.andWith(co[event.preset[i]]);
+        }
+
+        for (uint32_t y : event.postset) {
+            co[y] = common;
+            for (uint32_t sibling : event.postset) {
+                if (sibling != y) co[y].set(sibling);
+            }
+        }
+        // Symetria relacji: nowe warunki dopisujemy do zbiorów warunków z nimi współbieżnych.
+        common.forEach([&](size_t z) {
+            for (uint32_t y : event.postset) {
+                co[z].set(y);
+            }
+        });
+    }
+
+    // Wyszukuje rozszerzenia zawierające co najmniej jeden warunek wytworzony przez `producer`
+    // (-1 oznacza warunki początkowe). Każdy zbiór jest generowany dokładnie raz: pivotem jest
+    // jego najmniejszy nowy warunek.
+    // Zadania (pivot, przejście) są wykonywane równolegle tylko do odczytu prefiksu; wyniki trafiają
+    // do kolejki w kolejności zadań, więc prefiks jest taki sam jak przy jednym wątku.
+    void findExtensions(int producer) {
+        vector<uint32_t> newConditions;
+        if (producer < 0) {
+            for (uint32_t c = 0; c < prefix.initialConditions; ++c) newConditions.push_back(c);
+        } else {
+            newConditions = prefix.events[producer].postset;
+        }
+
+        // Sprawdzane są tylko przejścia z postsetu miejsca, którym etykietowany jest nowy warunek.
+        vector<pair<uint32_t, uint32_t>> tasks;
+        for (uint32_t pivot : newConditions) {
+            uint32_t place = prefix.conditions[pivot].place;
+            for (uint32_t k = net.consumerOffsets[place]; k < net.consumerOffsets[place + 1]; ++k) {
+                tasks.push_back({pivot, net.consumers[k]});
+            }
+        }
+
+        vector<vector<Extension>> results(tasks.size());
+        if (pool.threadCount() > 1 && tasks.size() > 1) {
+            pool.parallelFor(tasks.size(), [&](size_t i) {
+                extendWith(tasks[i].first, tasks[i].second, producer, results[i]);
+            });
+        } else {
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                extendWith(tasks[i].first, tasks[i].second, producer, results[i]);
+            }
+        }
+
+        // Deterministyczne scalanie: numery kolejności nadawane w porządku zadań.
+        for (vector<Extension>& found : results) {
+            for (Extension& extension : found) {
+                extension.sequence = nextSequence++;
+                queue.push(move(extension));
+            }
+        }
+    }
+
+    void extendWith(uint32_t pivot, uint32_t t, int producer, vector<Extension>& out) const {
+        uint32_t pivotPlace = prefix.conditions[pivot].place;
+
+        // Sloty presetu: miejsce powtórzone tyle razy, ile wynosi waga łuku; pivot zajmuje jeden slot.
+        vector<uint32_t> slots;
+        for (size_t k = net.preSparse.begin(t); k < net.preSparse.end(t); ++k) {
+            int copies = net.preSparse.weights[k] - (net.preSparse.places[k] == pivotPlace ? 1 : 0);
+            for (int w = 0; w < copies; ++w) {
+                slots.push_back(net.preSparse.places[k]);
+            }
+        }
+
+        // Kandydaci dla każdego miejsca: warunki z indeksu miejsca współbieżne z pivotem.
+        map<uint32_t, vector<uint32_t>> candidates;
+        for (uint32_t place : slots) {
+            if (candidates.count(place)) continue;
+            vector<uint32_t>& list = candidates[place];
+            for (uint32_t c : conditionsOfPlace[place]) {
+                if (!areConcurrent(pivot, c)) continue;
+                if (prefix.conditions[c].preEvent == producer && c < pivot) continue; // Ten zbiór ma mniejszy pivot.
+                list.push_back(c);
+            }
+        }
+
+        vector<uint32_t> chosen;
+        vector<Bitset> common = {co[pivot]};
+        chooseSlots(pivot, t, slots, candidates, chosen, common, out);
+    }
+
+    // Przeszukiwanie z nawrotami: wybór parami współbieżnych warunków dla kolejnych slotów.
+    // common.back() to iloczyn co(...) pivota i wybranych warunków, więc sprawdzenie kandydata to jeden bit.
+    void chooseSlots(uint32_t pivot, uint32_t t, const vector<uint32_t>& slots,
+                     map<uint32_t, vector<uint32_t>>& candidates, vector<uint32_t>& chosen, vector<Bitset>& common,
+                     vector<Extension>& out) const {
+        size_t slot = chosen.size();
+        if (slot == slots.size()) {
+            out.push_back(makeExtension(pivot, t, chosen));
+            return;
+        }
+
+        for (uint32_t c : candidates[slots[slot]]) {
+            // Sloty tego samego miejsca wypełniamy rosnąco, żeby nie generować permutacji.
+            if (slot > 0 && slots[slot - 1] == slots[slot] && c <= chosen.back()) continue;
+            if (!common.back().test(c)) continue;
+
+            chosen.push_back(c);
+            if (slot + 1 < slots.size()) {
+                common.push_back(common.back());
+                common.back().andWith(co[c]);
+            }
+            chooseSlots(pivot, t, slots, candidates, chosen, common, out);
+            if (slot + 1 < slots.size()) {
+                common.pop_back();
+            }
+            chosen.pop_back();
+        }
+    }
+
+    Extension makeExtension(uint32_t pivot, uint32_t t, const vector<uint32_t>& chosen) const {
+        Extension extension;
+        extension.transition = t;
+        extension.preset = chosen;
+        extension.preset.push_back(pivot);
+        sort(extension.preset.begin(), extension.preset.end());
+        for (uint32_t c : extension.preset) {
+            if (const Bitset* history = historyOf(c)) extension.history.orWith(*history);
+        }
+        extension.depth = 1;
+        for (uint32_t c : extension.preset) {
+            int producer = prefix.conditions[c].preEvent;
+            if (producer >= 0) extension.depth = max(extension.depth, prefix.events[producer].depth + 1);
+        }
+        extension.key = configurationKey(extension.history, t);
+        return extension;
+    }
+
+    // Klucz konfiguracji history + nowe zdarzenie (przejście t). Postać Foaty jest liczona dopiero
+    // wtedy, gdy rozmiar i wektor Parikha nie rozstrzygają porównania.
+    ConfigKey configurationKey(const Bitset& history, uint32_t t) const {
+        ConfigKey key;
+        key.size = static_cast<uint32_t>(history.count() + 1);
+        if (options.order == AdequateOrder::McMillan) {
+            return key;
+        }
+
+        vector<uint32_t> all; // Przejścia wszystkich zdarzeń konfiguracji.
+        history.forEach([&](size_t e) { all.push_back(prefix.events[e].transition); });
+        all.push_back(t);
+        key.parikh = toParikh(all);
+        return key;
+    }
+
+    // Uzupełnia postać Foaty konfiguracji events (+ ewentualnie nowe zdarzenie extraTransition
+    // na poziomie depth; depth to zarazem liczba poziomów).
+    void ensureFoata(ConfigKey& key, const Bitset& events, int extraTransition, uint32_t depth) {
+        if (key.foataReady) {
+            return;
+        }
+        vector<vector<uint32_t>> levels(depth); // Przejścia zdarzeń na kolejnych poziomach Foaty.
+        events.forEach([&](size_t e) {
+            const Event& event = prefix.events[e];
+            levels[event.depth - 1].push_back(event.transition);
+        });
+        if (extraTransition >= 0) {
+            levels[depth - 1].push_back(static_cast<uint32_t>(extraTransition));
+        }
+        for (auto& level : levels) {
+            key.foata.push_back(toParikh(level));
+        }
+        key.foataReady = true;
+        prefix.foataComputations++;
+    }
+
+    // Porównanie konfiguracji lokalnych dwóch dodanych zdarzeń.
+    int compareEventConfigs(uint32_t a, uint32_t b) {
+        int c = compareSizeAndParikh(eventKeys[a], eventKeys[b], options.order);
+        if (c == 0 && options.order == AdequateOrder::ERV) {
+            ensureFoata(eventKeys[a], prefix.events[a].localConfig, -1, prefix.events[a].depth);
+            ensureFoata(eventKeys[b], prefix.events[b].localConfig, -1, prefix.events[b].depth);
+            c = compareFoata(eventKeys[a], eventKeys[b]);
+        }
+        return c;
+    }
+};
+
+// Rozwinięcie wymaga przejść z niepustym presetem: przejście bez miejsc wejściowych jest aktywne zawsze,
+// ale jako zdarzenie (t, pusty zbiór warunków) wystąpiłoby w rozwinięciu tylko raz, więc prefiks nie
+// byłby kompletny. Takie sieci są odrzucane, zanim Unfolder je zobaczy.
+Prefix unfoldingMcMillan(const PetriNet& net, const UnfoldingOptions& options) {
+    for (size_t t = 0; t < net.transitions.size(); ++t) {
+        if (net.preSparse.begin(t) == net.preSparse.end(t)) {
+            throw runtime_error("Przejście " + net.transitions[t] + " ma pusty preset; silnik mcmillan go nie obsługuje");
+        }
+    }
+    STATS_TIMER(explore);
+    Unfolder unfolder(net, options);
+    return unfolder.run();
+}
+
+// Zapisuje prefiks w tym samym układzie co wynik unfoldingu: wiersze to warunki, kolumny to zdarzenia
+// (-1 = warunek wejściowy, 1 = warunek wyjściowy). Nazwy mają postać <miejsce>_<k> i <przejście>_<k>.
+// Wiersze macierzy są wyznaczane po kolei z preEvent/postEvents warunku, więc w pamięci jest tylko jeden.
+// "Companion" podaje dla każdego zdarzenia z "Cutoff" zdarzenie o tym samym oznakowaniu ("" = pusta konfiguracja).
+void savePrefixToJSON(const string& filename, const PetriNet& net, const Prefix& prefix, bool compact = false) {
+    STATS_TIMER(save);
+    vector<string> conditionNames, eventNames, cutoffNames, companionNames;
+    map<string, int> duplicateCounts; // Numer kolejnej kopii miejsca/przejścia.
+
+    for (const Condition& condition : prefix.conditions) {
+        const string& place = net.places[condition.place];
+        conditionNames.push_back(place + "_" + to_string(++duplicateCounts[place]));
+    }
+    for (size_t e = 0; e < prefix.events.size(); ++e) {
+        const Event& event = prefix.events[e];
+        const string& transition = net.transitions[event.transition];
+        eventNames.push_back(transition + "_" + to_string(++duplicateCounts[transition]));
+        if (event.cutoff) cutoffNames.push_back(eventNames.back());
+    }
+    for (const Event& event : prefix.events) {
+        if (event.cutoff) companionNames.push_back(event.companion >= 0 ? eventNames[event.companion] : "");
+    }
+
+    vector<int> initialMarking(prefix.conditions.size(), 0);
+    for (size_t c = 0; c < prefix.initialConditions; ++c) {
+        initialMarking[c] = 1;
+    }
+
+    JsonStreamWriter writer(filename, compact);
+    writer.beginObject();
+    writer.key("Companion");
+    writer.stringArray(companionNames);
+    writer.key("Cutoff");
+    writer.stringArray(cutoffNames);
+    writer.key("InitialMarking");
+    writer.numberArray(initialMarking.data(), initialMarking.size());
+    writer.key("Place");
+    writer.stringArray(conditionNames);
+    writer.key("Transition");
+    writer.stringArray(eventNames);
+    writer.key("matrix");
+    writer.beginArray();
+    vector<int> row(prefix.events.size(), 0);
+    for (const Condition& condition : prefix.conditions) {
+        if (condition.preEvent >= 0) row[condition.preEvent] = 1;
+        for (uint32_t e : condition.postEvents) row[e] = -1;
+        writer.numberArray(row.data(), row.size());
+        if (condition.preEvent >= 0) row[condition.preEvent] = 0;
+        for (uint32_t e : condition.postEvents) row[e] = 0;
+    }
+    writer.endArray();
+    writer.endObject();
+    writer.close();
+}
+
+// ---------------------------------------------------------------------------
+// Format binarny sieci i prefiksu: nagłówek i płaskie tablice, które można odwzorować w pamięci
+// (mmap) i czytać bez parsowania. Liczby zapisane są w porządku bajtów maszyny, która utworzyła plik
+// (sprawdzanym przy odczycie), a każda tablica zaczyna się na granicy 8 bajtów.
+//
+// Sieć:    initialMarking int32[P], preOffsets uint32[T+1], prePlaces uint32[A], preWeights int32[A],
+//          postOffsets uint32[T+1], postPlaces uint32[B], postWeights int32[B].
+// Prefiks: conditionPlace uint32[C], conditionPreEvent int32[C], eventTransition uint32[E],
+//          eventCompanion int32[E], eventCutoff uint8[E], presetOffsets uint32[E+1], presets uint32[],
+//          postsetOffsets uint32[E+1], postsets uint32[].
+// ---------------------------------------------------------------------------
+
+constexpr uint32_t BINARY_VERSION = 1;
+constexpr uint32_t BINARY_BYTE_ORDER = 0x01020304;
+constexpr char BINARY_NET_MAGIC[8] = {'P', 'E', 'T', 'R', 'I', 'N', 'E', 'T'};
+constexpr char BINARY_PREFIX_MAGIC[8] = {'U', 'N', 'F', 'P', 'R', 'E', 'F', 'X'};
+
+struct BinaryNetHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t placeCount;
+    uint64_t transitionCount;
+    uint64_t preArcCount;
+    uint64_t postArcCount;
+};
+
+struct BinaryPrefixHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t placeCount;          // Wymiary sieci, z której powstał prefiks (do odtworzenia nazw).
+    uint64_t transitionCount;
+    uint64_t conditionCount;
+    uint64_t eventCount;
+    uint64_t presetCount;         // Suma rozmiarów presetów zdarzeń.
+    uint64_t postsetCount;        // Suma rozmiarów postsetów zdarzeń.
+    uint64_t initialConditions;
+    uint64_t cutoffCount;
+};
+
+// Plik odwzorowany w pamięci tylko do odczytu.
+class MappedFile {
+public:
+    explicit MappedFile(const string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw runtime_error("Nie można otworzyć pliku: " + filename);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (!view) {
+                close();
+                throw runtime_error("Nie można odwzorować pliku w pamięci: " + filename);
+            }
+            bytes = static_cast<const uint8_t*>(view);
+        }
+#else
+        descriptor = open(filename.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            throw runtime_error("Nie można otworzyć pliku: " + filename);
+        }
+        struct stat info;
+        if (fstat(descriptor, &info) != 0) {
+            close();
+            throw runtime_error("Nie można odczytać rozmiaru pliku: " + filename);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (view == MAP_FAILED) {
+                close();
+                throw runtime_error("Nie można odwzorować pliku w pamięci: " + filename);
+            }
+            bytes = static_cast<const uint8_t*>(view);
+        }
+#endif
+    }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // Czy plik zaczyna się od podanego 8-bajtowego znacznika.
+    bool hasMagic(const char (&magic)[8]) const {
+        return length >= 8 && memcmp(bytes, magic, 8) == 0;
+    }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+
+    void close() {
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        bytes = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+    }
+#else
+    int descriptor = -1;
+
+    void close() {
+        if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+        if (descriptor >= 0) ::close(descriptor);
+        bytes = nullptr;
+        descriptor = -1;
+    }
+#endif
+};
+
+// Kolejne tablice pliku binarnego jako wskaźniki do odwzorowanej pamięci (bez kopiowania).
+class BinaryCursor {
+public:
+    BinaryCursor(const MappedFile& file, const string& filename) : file(file), filename(filename) {}
+
+    // Liczby elementów pochodzą z nagłówka, więc są porównywane z resztą pliku bez mnożenia,
+    // które mogłoby się przepełnić.
+    template <typename T>
+    const T* take(uint64_t count) {
+        size_t available = offset < file.size() ? file.size() - offset : 0;
+        if (count > available / sizeof(T)) {
+            throw runtime_error("Plik binarny " + filename + " jest ucięty");
+        }
+        size_t bytes = static_cast<size_t>(count) * sizeof(T);
+        const T* data = reinterpret_cast<const T*>(file.data() + offset);
+        offset += (bytes + 7) / 8 * 8;
+        return data;
+    }
+
+    // Zakresy CSR: count + 1 początków. Każdy zajmuje 4 bajty, więc count nie mniejszy od rozmiaru
+    // pliku oznacza plik ucięty (i wyklucza przepełnienie count + 1).
+    const uint32_t* takeOffsets(uint64_t count) {
+        if (count >= file.size()) {
+            throw runtime_error("Plik binarny " + filename + " jest ucięty");
+        }
+        return take<uint32_t>(count + 1);
+    }
+
+    // Sprawdza znacznik, wersję i porządek bajtów nagłówka.
+    template <typename Header>
+    const Header* header(const char (&magic)[8]) {
+        if (!file.hasMagic(magic)) {
+            throw runtime_error("Plik " + filename + " nie jest plikiem binarnym oczekiwanego rodzaju");
+        }
+        const Header* result = take<Header>(1);
+        if (result->byteOrder != BINARY_BYTE_ORDER) {
+            throw runtime_error("Plik binarny " + filename + " ma inny porządek bajtów");
+        }
+        if (result->version != BINARY_VERSION) {
+            throw runtime_error("Nieobsługiwana wersja pliku binarnego " + filename + ": " + to_string(result->version));
+        }
+        return result;
+    }
+
+private:
+    const MappedFile& file;
+    string filename;
+    size_t offset = 0;
+};
+
+// Zapis kolejnych tablic z wyrównaniem do 8 bajtów.
+class BinaryWriter {
+public:
+    explicit BinaryWriter(const string& filename) : file(filename, ios::binary), filename(filename) {
+        if (!file) {
+            throw runtime_error("Nie można otworzyć pliku wyjściowego: " + filename);
+        }
+    }
+
+    template <typename T>
+    void write(const T* data, size_t count) {
+        static const char padding[8] = {};
+        size_t bytes = count * sizeof(T);
+        file.write(reinterpret_cast<const char*>(data), bytes);
+        file.write(padding, (8 - bytes % 8) % 8);
+    }
+
+    template <typename T>
+    void write(const vector<T>& data) { write(data.data(), data.size()); }
+
+    // Zamyka plik i zgłasza błąd zapisu (np. brak miejsca na dysku).
+    void close() {
+        file.close();
+        if (!file) {
+            throw runtime_error("Błąd zapisu pliku wyjściowego: " + filename);
+        }
+    }
+
+private:
+    ofstream file;
+    string filename;
+};
+
+// Widok sieci zapisanej binarnie: wskaźniki prowadzą do odwzorowanego pliku.
+struct BinaryNetView {
+    const BinaryNetHeader* header;
+    const int32_t* initialMarking;
+    const uint32_t* preOffsets;
+    const uint32_t* prePlaces;
+    const int32_t* preWeights;
+    const uint32_t* postOffsets;
+    const uint32_t* postPlaces;
+    const int32_t* postWeights;
+};
+
+BinaryNetView viewBinaryNet(const MappedFile& file, const string& filename) {
+    BinaryCursor cursor(file, filename);
+    BinaryNetView view;
+    view.header = cursor.header<BinaryNetHeader>(BINARY_NET_MAGIC);
+    uint64_t placeCount = view.header->placeCount;
+    uint64_t transitionCount = view.header->transitionCount;
+    view.initialMarking = cursor.take<int32_t>(placeCount);
+    view.preOffsets = cursor.takeOffsets(transitionCount);
+    view.prePlaces = cursor.take<uint32_t>(view.header->preArcCount);
+    view.preWeights = cursor.take<int32_t>(view.header->preArcCount);
+    view.postOffsets = cursor.takeOffsets(transitionCount);
+    view.postPlaces = cursor.take<uint32_t>(view.header->postArcCount);
+    view.postWeights = cursor.take<int32_t>(view.header->postArcCount);
+    return view;
+}
+
+// Kopiuje zakresy CSR z pliku wprost do SparseArcs. Plik zapisuje je już posortowane i scalone, więc
+// wystarczy sprawdzić, że zakresy są monotoniczne, a miejsca w obrębie przejścia ściśle rosnące.
+SparseArcs sparseArcsFromBinary(const uint32_t* offsets, const uint32_t* places, const int32_t* weights,
+                                size_t arcCount, size_t placeCount, size_t transitionCount, const string& filename) {
+    if (offsets[0] != 0 || offsets[transitionCount] != arcCount) {
+        throw runtime_error("Niepoprawne zakresy łuków w pliku " + filename);
+    }
+    for (size_t t = 0; t < transitionCount; ++t) {
+        if (offsets[t] > offsets[t + 1]) {
+            throw runtime_error("Niepoprawne zakresy łuków w pliku " + filename);
+        }
+        for (size_t k = offsets[t]; k < offsets[t + 1]; ++k) {
+            if (places[k] >= placeCount || weights[k] <= 0 || (k > offsets[t] && places[k] <= places[k - 1])) {
+                throw runtime_error("Niepoprawny łuk w pliku " + filename);
+            }
+        }
+    }
+    SparseArcs sparse;
+    sparse.offsets.assign(offsets, offsets + transitionCount + 1);
+    sparse.places.assign(places, places + arcCount);
+    sparse.weights.assign(weights, weights + arcCount);
+    return sparse;
+}
+
+// Wczytuje sieć z pliku binarnego; zamiast parsowania tablice są czytane wprost z odwzorowania.
+PetriNet loadFromBinary(const string& filename, LoadStats* stats = nullptr) {
+    STATS_TIMER(load);
+    auto start = chrono::steady_clock::now();
+    MappedFile file(filename);
+    BinaryNetView view = viewBinaryNet(file, filename);
+    size_t placeCount = view.header->placeCount;
+    size_t transitionCount = view.header->transitionCount;
+
+    PetriNet net;
+    net.initialMarking.assign(view.initialMarking, view.initialMarking + placeCount);
+    for (int tokens : net.initialMarking) {
+        if (tokens < 0) {
+            throw runtime_error("Ujemna liczba tokenów w oznakowaniu początkowym w pliku " + filename);
+        }
+    }
+    for (size_t i = 1; i <= placeCount; ++i) {
+        net.places.push_back("p" + to_string(i));
+    }
+    for (size_t i = 1; i <= transitionCount; ++i) {
+        net.transitions.push_back("t" + to_string(i));
+    }
+    net.preSparse = sparseArcsFromBinary(view.preOffsets, view.prePlaces, view.preWeights, view.header->preArcCount, placeCount, transitionCount, filename);
+    net.postSparse = sparseArcsFromBinary(view.postOffsets, view.postPlaces, view.postWeights, view.header->postArcCount, placeCount, transitionCount, filename);
+    buildArcIndexes(net);
+
+    if (stats) {
+        stats->bytes = file.size();
+        stats->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    return net;
+}
+
+void saveNetToBinary(const string& filename, const PetriNet& net) {
+    BinaryNetHeader header = {};
+    memcpy(header.magic, BINARY_NET_MAGIC, 8);
+    header.version = BINARY_VERSION;
+    header.byteOrder = BINARY_BYTE_ORDER;
+    header.placeCount = net.places.size();
+    header.transitionCount = net.transitions.size();
+    header.preArcCount = net.preSparse.places.size();
+    header.postArcCount = net.postSparse.places.size();
+
+    BinaryWriter writer(filename);
+    writer.write(&header, 1);
+    writer.write(net.initialMarking);
+    writer.write(net.preSparse.offsets);
+    writer.write(net.preSparse.places);
+    writer.write(net.preSparse.weights);
+    writer.write(net.postSparse.offsets);
+    writer.write(net.postSparse.places);
+    writer.write(net.postSparse.weights);
+    writer.close();
+}
+
+// Zapisuje sieć w formacie JSON z listami łuków (indeksy od 0).
+void saveNetToJSON(const string& filename, const PetriNet& net, bool compact = false) {
+    JsonStreamWriter writer(filename, compact);
+    auto writeArcs = [&](const SparseArcs& arcs) {
+        writer.beginArray();
+        for (size_t t = 0; t < net.transitions.size(); ++t) {
+            for (size_t k = arcs.begin(t); k < arcs.end(t); ++k) {
+                long long arc[3] = {arcs.places[k], static_cast<long long>(t), arcs.weights[k]};
+                writer.numberArray(arc, 3);
+            }
+        }
+        writer.endArray();
+    };
+    writer.beginObject();
+    writer.key("initialMarking");
+    writer.numberArray(net.initialMarking.data(), net.initialMarking.size());
+    writer.key("postArcs");
+    writeArcs(net.postSparse);
+    writer.key("preArcs");
+    writeArcs(net.preSparse);
+    writer.key("transitionCount");
+    writer.value(static_cast<long long>(net.transitions.size()));
+    writer.endObject();
+    writer.close();
+}
+
+// Widok prefiksu zapisanego binarnie (dla narzędzi, które czytają wynik bez jego odtwarzania).
+struct BinaryPrefixView {
+    const BinaryPrefixHeader* header;
+    const uint32_t* conditionPlace;
+    const int32_t* conditionPreEvent;
+    const uint32_t* eventTransition;
+    const int32_t* eventCompanion;
+    const uint8_t* eventCutoff;
+    const uint32_t* presetOffsets;
+    const uint32_t* presets;
+    const uint32_t* postsetOffsets;
+    const uint32_t* postsets;
+};
+
+BinaryPrefixView viewBinaryPrefix(const MappedFile& file, const string& filename) {
+    BinaryCursor cursor(file, filename);
+    BinaryPrefixView view;
+    view.header = cursor.header<BinaryPrefixHeader>(BINARY_PREFIX_MAGIC);
+    uint64_t conditionCount = view.header->conditionCount;
+    uint64_t eventCount = view.header->eventCount;
+    view.conditionPlace = cursor.take<uint32_t>(conditionCount);
+    view.conditionPreEvent = cursor.take<int32_t>(conditionCount);
+    view.eventTransition = cursor.take<uint32_t>(eventCount);
+    view.eventCompanion = cursor.take<int32_t>(eventCount);
+    view.eventCutoff = cursor.take<uint8_t>(eventCount);
+    view.presetOffsets = cursor.takeOffsets(eventCount);
+    view.presets = cursor.take<uint32_t>(view.header->presetCount);
+    view.postsetOffsets = cursor.takeOffsets(eventCount);
+    view.postsets = cursor.take<uint32_t>(view.header->postsetCount);
+    return view;
+}
+
+void savePrefixToBinary(const string& filename, const PetriNet& net, const Prefix& prefix) {
+    STATS_TIMER(save);
+    BinaryPrefixHeader header = {};
+    memcpy(header.magic, BINARY_PREFIX_MAGIC, 8);
+    header.version = BINARY_VERSION;
+    header.byteOrder = BINARY_BYTE_ORDER;
+    header.placeCount = net.places.size();
+    header.transitionCount = net.transitions.size();
+    header.conditionCount = prefix.conditions.size();
+    header.eventCount = prefix.events.size();
+    header.initialConditions = prefix.initialConditions;
+    header.cutoffCount = prefix.cutoffCount;
+
+    vector<uint32_t> conditionPlace, eventTransition, presetOffsets = {0}, presets, postsetOffsets = {0}, postsets;
+    vector<int32_t> conditionPreEvent, eventCompanion;
+    vector<uint8_t> eventCutoff;
+    for (const Condition& condition : prefix.conditions) {
+        conditionPlace.push_back(condition.place);
+        conditionPreEvent.push_back(condition.preEvent);
+    }
+    for (const Event& event : prefix.events) {
+        eventTransition.push_back(event.transition);
+        eventCompanion.push_back(event.companion);
+        eventCutoff.push_back(event.cutoff ? 1 : 0);
+        presets.insert(presets.end(), event.preset.begin(), event.preset.end());
+        presetOffsets.push_back(static_cast<uint32_t>(presets.size()));
+        postsets.insert(postsets.end(), event.postset.begin(), event.postset.end());
+        postsetOffsets.push_back(static_cast<uint32_t>(postsets.size()));
+    }
+    header.presetCount = presets.size();
+    header.postsetCount = postsets.size();
+
+    BinaryWriter writer(filename);
+    writer.write(&header, 1);
+    writer.write(conditionPlace);
+    writer.write(conditionPreEvent);
+    writer.write(eventTransition);
+    writer.write(eventCompanion);
+    writer.write(eventCutoff);
+    writer.write(presetOffsets);
+    writer.write(presets);
+    writer.write(postsetOffsets);
+    writer.write(postsets);
+    writer.close();
+}
+
+// Odtwarza prefiks (struktura warunków i zdarzeń) z pliku binarnego. Sieć w wyniku ma tylko nazwy
+// miejsc i przejść - wystarczające do zapisu prefiksu w JSON.
+Prefix loadPrefixFromBinary(const string& filename, PetriNet& namesOnly) {
+    MappedFile file(filename);
+    BinaryPrefixView view = viewBinaryPrefix(file, filename);
+    const BinaryPrefixHeader& header = *view.header;
+
+    namesOnly = PetriNet();
+    for (size_t i = 1; i <= header.placeCount; ++i) {
+        namesOnly.places.push_back("p" + to_string(i));
+    }
+    for (size_t i = 1; i <= header.transitionCount; ++i) {
+        namesOnly.transitions.push_back("t" + to_string(i));
+    }
+
+    if (header.initialConditions > header.conditionCount || header.cutoffCount > header.eventCount) {
+        throw runtime_error("Niepoprawny nagłówek prefiksu w pliku " + filename);
+    }
+    Prefix prefix;
+    prefix.initialConditions = header.initialConditions;
+    prefix.cutoffCount = header.cutoffCount;
+    for (size_t c = 0; c < header.conditionCount; ++c) {
+        if (view.conditionPlace[c] >= header.placeCount || view.conditionPreEvent[c] < -1
+            || view.conditionPreEvent[c] >= static_cast<int64_t>(header.eventCount)) {
+            throw runtime_error("Niepoprawny warunek w pliku " + filename);
+        }
+        prefix.conditions.push_back({view.conditionPlace[c], view.conditionPreEvent[c], {}});
+    }
+    // Zakres [offsets[e], offsets[e + 1]) musi być niemalejący i mieścić się w tablicy o count elementach.
+    auto validRange = [](const uint32_t* offsets, size_t e, uint64_t count) {
+        return offsets[e] <= offsets[e + 1] && offsets[e + 1] <= count;
+    };
+    auto validConditions = [&](const vector<uint32_t>& conditions) {
+        return all_of(conditions.begin(), conditions.end(), [&](uint32_t c) { return c < header.conditionCount; });
+    };
+    for (size_t e = 0; e < header.eventCount; ++e) {
+        Event event;
+        event.transition = view.eventTransition[e];
+        event.companion = view.eventCompanion[e];
+        event.cutoff = view.eventCutoff[e] != 0;
+        if (event.transition >= header.transitionCount || event.companion < -1
+            || event.companion >= static_cast<int64_t>(header.eventCount)
+            || !validRange(view.presetOffsets, e, header.presetCount) || !validRange(view.postsetOffsets, e, header.postsetCount)) {
+            throw runtime_error("Niepoprawne zdarzenie w pliku " + filename);
+        }
+        event.preset.assign(view.presets + view.presetOffsets[e], view.presets + view.presetOffsets[e + 1]);
+        event.postset.assign(view.postsets + view.postsetOffsets[e], view.postsets + view.postsetOffsets[e + 1]);
+        if (!validConditions(event.preset) || !validConditions(event.postset)) {
+            throw runtime_error("Niepoprawne zdarzenie w pliku " + filename);
+        }
+        for (uint32_t c : event.preset) {
+            prefix.conditions[c].postEvents.push_back(static_cast<uint32_t>(e));
+        }
+        prefix.events.push_back(move(event));
+    }
+    return prefix;
+}
+
+// Odczytuje indeks z nazwy w postaci <litera><numer>_<kopia> (np. "p3_2" -> 2).
+size_t indexFromName(const string& name, const string& filename) {
+    size_t end = name.find('_');
+    if (name.size() < 2 || end == string::npos || end < 2) {
+        throw runtime_error("Niepoprawna nazwa '" + name + "' w pliku " + filename);
+    }
+    return stoul(name.substr(1, end - 1)) - 1;
+}
+
+// Odtwarza prefiks zapisany przez savePrefixToJSON (wiersze = warunki, kolumny = zdarzenia).
+Prefix loadPrefixFromJSON(const string& filename, PetriNet& namesOnly) {
+    ifstream file(filename);
+    json j;
+    file >> j;
+    Matrix matrix = j["matrix"].get<Matrix>();
+    vector<string> conditionNames = j["Place"].get<vector<string>>();
+    vector<string> eventNames = j["Transition"].get<vector<string>>();
+    vector<string> cutoffNames = j["Cutoff"].get<vector<string>>();
+    vector<int> initialMarking = j["InitialMarking"].get<vector<int>>();
+    set<string> cutoffs(cutoffNames.begin(), cutoffNames.end());
+    if (matrix.size() != conditionNames.size() || initialMarking.size() != conditionNames.size()) {
+        throw runtime_error("Niezgodne wymiary prefiksu w pliku " + filename);
+    }
+
+    Prefix prefix;
+    size_t placeCount = 0, transitionCount = 0;
+    for (size_t c = 0; c < conditionNames.size(); ++c) {
+        uint32_t place = static_cast<uint32_t>(indexFromName(conditionNames[c], filename));
+        placeCount = max<size_t>(placeCount, place + 1);
+        prefix.conditions.push_back({place, -1, {}});
+        prefix.initialConditions += initialMarking[c] ? 1 : 0;
+    }
+    for (size_t e = 0; e < eventNames.size(); ++e) {
+        Event event;
+        event.transition = static_cast<uint32_t>(indexFromName(eventNames[e], filename));
+        event.cutoff = cutoffs.count(eventNames[e]) > 0;
+        transitionCount = max<size_t>(transitionCount, event.transition + 1);
+        prefix.cutoffCount += event.cutoff ? 1 : 0;
+        prefix.events.push_back(move(event));
+    }
+    if (j.contains("Companion")) { // Brak klucza (starsze pliki) pozostawia companion = -1.
+        vector<string> companionNames = j["Companion"].get<vector<string>>();
+        if (companionNames.size() != cutoffNames.size()) {
+            throw runtime_error("Niezgodne wymiary prefiksu w pliku " + filename);
+        }
+        map<string, int> eventIndex;
+        for (size_t e = 0; e < eventNames.size(); ++e) {
+            eventIndex[eventNames[e]] = static_cast<int>(e);
+        }
+        for (size_t k = 0; k < cutoffNames.size(); ++k) {
+            auto cutoff = eventIndex.find(cutoffNames[k]);
+            auto companion = eventIndex.find(companionNames[k]);
+            if (cutoff == eventIndex.end() || (!companionNames[k].empty() && companion == eventIndex.end())) {
+                throw runtime_error("Nieznane zdarzenie w 'Companion' w pliku " + filename);
+            }
+            prefix.events[cutoff->second].companion = companionNames[k].empty() ? -1 : companion->second;
+        }
+    }
+    for (size_t c = 0; c < matrix.size(); ++c) {
+        if (matrix[c].size() != eventNames.size()) {
+            throw runtime_error("Niezgodne wymiary prefiksu w pliku " + filename);
+        }
+        for (size_t e = 0; e < eventNames.size(); ++e) {
+            if (matrix[c][e] < 0) {
+                prefix.events[e].preset.push_back(static_cast<uint32_t>(c));
+                prefix.conditions[c].postEvents.push_back(static_cast<uint32_t>(e));
+            } else if (matrix[c][e] > 0) {
+                prefix.events[e].postset.push_back(static_cast<uint32_t>(c));
+                prefix.conditions[c].preEvent = static_cast<int>(e);
+            }
+        }
+    }
+
+    namesOnly = PetriNet();
+    for (size_t i = 1; i <= placeCount; ++i) {
+        namesOnly.places.push_back("p" + to_string(i));
+    }
+    for (size_t i = 1; i <= transitionCount; ++i) {
+        namesOnly.transitions.push_back("t" + to_string(i));
+    }
+    return prefix;
+}
+
+// Zbiera klucze obiektu głównego pliku JSON; pozostałe wartości są tylko parsowane, bez budowania drzewa.
+class TopLevelKeys : public nlohmann::json_sax<json> {
+public:
+    set<std::string> keys;
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t) override { return true; }
+    bool number_unsigned(number_unsigned_t) override { return true; }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool string(string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
+    bool start_object(size_t) override { ++depth; return true; }
+    bool end_object() override { --depth; return true; }
+    bool start_array(size_t) override { ++depth; return true; }
+    bool end_array() override { --depth; return true; }
+
+    bool key(string_t& name) override {
+        if (depth == 1) {
+            keys.insert(name);
+        }
+        return true;
+    }
+
+    bool parse_error(size_t position, const std::string&, const nlohmann::detail::exception& error) override {
+        throw runtime_error("Błąd składni JSON (bajt " + to_string(position) + "): " + error.what());
+    }
+
+private:
+    int depth = 0;
+};
+
+bool endsWith(const string& text, const string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Wczytuje sieć z pliku JSON albo binarnego (rozpoznawanego po znaczniku na początku pliku).
+PetriNet loadNet(const string& filename, LoadStats* stats = nullptr) {
+    char magic[8] = {};
+    ifstream(filename, ios::binary).read(magic, 8);
+    if (memcmp(magic, BINARY_NET_MAGIC, 8) == 0) {
+        return loadFromBinary(filename, stats);
+    }
+    return loadFromJSON(filename, stats);
+}
+
+// Zapisuje prefiks binarnie, gdy plik wyjściowy ma rozszerzenie .bin, a w przeciwnym razie jako JSON.
+void savePrefix(const string& filename, const PetriNet& net, const Prefix& prefix, bool compact = false) {
+    if (endsWith(filename, ".bin")) {
+        savePrefixToBinary(filename, net, prefix);
+    } else {
+        savePrefixToJSON(filename, net, prefix, compact);
+    }
+}
+
+// Konwersja między JSON a formatem binarnym (kierunek i rodzaj pliku - sieć czy prefiks - wynikają
+// z zawartości wejścia). Wejście binarne jest zapisywane jako JSON, wejście JSON jako plik binarny.
+void convertFile(const string& inputFile, const string& outputFile, bool compact) {
+    MappedFile input(inputFile);
+    PetriNet net;
+    if (input.hasMagic(BINARY_NET_MAGIC)) {
+        saveNetToJSON(outputFile, loadFromBinary(inputFile), compact);
+        return;
+    }
+    if (input.hasMagic(BINARY_PREFIX_MAGIC)) {
+        Prefix prefix = loadPrefixFromBinary(inputFile, net);
+        savePrefixToJSON(outputFile, net, prefix, compact);
+        return;
+    }
+
+    // Prefiks ma klucz "InitialMarking" (wynik silnika), a sieć - "initialMarking".
+    TopLevelKeys top;
+    const char* text = reinterpret_cast<const char*>(input.data());
+    json::sax_parse(text, text + input.size(), &top);
+    if (top.keys.count("InitialMarking") && !top.keys.count("initialMarking")) {
+        Prefix prefix = loadPrefixFromJSON(inputFile, net);
+        savePrefixToBinary(outputFile, net, prefix);
+    } else {
+        saveNetToBinary(outputFile, loadFromJSON(inputFile));
+    }
+}
+
+ResultMatrixBuilder unfoldingSafe(const PetriNet& net, PackedMarkingStore& markingHistory, const ExplorationOptions& options, ExplorationStats& stats) {
+    ResultMatrixBuilder resultMatrix;
+    SafeStateSpace space(net);
+    stats = exploreStateSpace(space, markingHistory, resultMatrix, options);
+    return resultMatrix;
+}
+
+// ---------------------------------------------------------------------------
+// Równoległe przeszukiwanie wszerz całego zbioru osiągalnych oznakowań.
+// ---------------------------------------------------------------------------
+
+// Tablica odwiedzonych oznakowań współdzielona przez wątki bez blokad. Slot to słowo 64-bitowe:
+// górne 32 bity to odcisk hasza (nigdy 0), dolne to id + 1 (0 = slot zarezerwowany, id jeszcze
+// nieopublikowane). Wątek rezerwuje pusty slot przez CAS, zapisuje oznakowanie do areny i dopiero
+// wtedy publikuje id; inne wątki z tym samym odciskiem czekają na publikację przed porównaniem.
+// Tablica nie rośnie podczas wstawiania: po przekroczeniu limitu insert zwraca Full, a grow()
+// wywołuje się między poziomami BFS, gdy żaden wątek nie wstawia.
+class ConcurrentMarkingTable {
+public:
+    enum class InsertResult { Existing, Inserted, Full };
+
+    ConcurrentMarkingTable(size_t width, size_t extraIds, size_t expectedMarkings = 1 << 16)
+        : width(width), extraIds(extraIds) {
+        size_t capacity = 16;
+        while (capacity * MAX_LOAD_NUM < expectedMarkings * MAX_LOAD_DEN) {
+            capacity *= 2;
+        }
+        allocate(capacity);
+    }
+
+    // Wstawia oznakowanie (o znanym haszu), jeśli go jeszcze nie ma. Zwraca {id, wynik}.
+    pair<uint32_t, InsertResult> insert(const int* marking, uint64_t hash) {
+        if (count.load(memory_order_relaxed) >= limit) {
+            return {0, InsertResult::Full};
+        }
+        uint64_t fingerprint = (hash >> 32) | 1;
+        size_t mask = slotCount - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            uint64_t value = slots[slot].load(memory_order_acquire);
+            if (value == 0) {
+                uint64_t reserved = fingerprint << 32;
+                if (!slots[slot].compare_exchange_strong(value, reserved, memory_order_acq_rel)) {
+                    if ((value >> 32) != fingerprint) {
+                        continue; // Slot zajął inny odcisk.
+                    }
+                } else {
+                    uint32_t id = static_cast<uint32_t>(count.fetch_add(1, memory_order_relaxed));
+                    copy(marking, marking + width, tokens.begin() + static_cast<size_t>(id) * width);
+                    hashes[id] = hash;
+                    slots[slot].store(reserved | (id + 1), memory_order_release);
+                    return {id, InsertResult::Inserted};
+                }
+            }
+            if ((value >> 32) != fingerprint) {
+                continue;
+            }
+            while ((value & 0xFFFFFFFFULL) == 0) { // Czeka, aż właściciel slotu opublikuje id.
+                this_thread::yield();
+                value = slots[slot].load(memory_order_acquire);
+            }
+            uint32_t id = static_cast<uint32_t>((value & 0xFFFFFFFFULL) - 1);
+            if (hashes[id] == hash && equal(marking, marking + width, tokens.begin() + static_cast<size_t>(id) * width)) {
+                return {id, InsertResult::Existing};
+            }
+        }
+    }
+
+    const int* marking(uint32_t id) const { return tokens.data() + static_cast<size_t>(id) * width; }
+    uint64_t hashOf(uint32_t id) const { return hashes[id]; }
+    size_t size() const { return count.load(); }
+    size_t capacity() const { return slotCount; }
+    bool halfFull() const { return count.load() * 2 >= limit; }
+
+    // Podwaja tablicę i arenę. Nie wolno wywoływać współbieżnie z insert.
+    void grow() {
+        size_t stored = count.load();
+        vector<int> oldTokens = move(tokens);
+        vector<uint64_t> oldHashes = move(hashes);
+        allocate(slotCount * 2);
+        copy(oldTokens.begin(), oldTokens.begin() + stored * width, tokens.begin());
+        copy(oldHashes.begin(), oldHashes.begin() + stored, hashes.begin());
+        size_t mask = slotCount - 1;
+        for (uint32_t id = 0; id < stored; ++id) {
+            size_t slot = hashes[id] & mask;
+            while (slots[slot].load(memory_order_relaxed) != 0) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot].store((((hashes[id] >> 32) | 1) << 32) | (id + 1), memory_order_relaxed);
+        }
+        grows++;
+    }
+
+    size_t growCount() const { return grows; }
+
+private:
+    static constexpr size_t MAX_LOAD_NUM = 7;
+    static constexpr size_t MAX_LOAD_DEN = 10;
+
+    size_t width;                 // Liczba miejsc (długość oznakowania).
+    size_t extraIds;              // Zapas id na wątki, które przeszły sprawdzenie limitu jednocześnie.
+    size_t slotCount = 0;
+    size_t limit = 0;             // Liczba oznakowań, po której insert zwraca Full.
+    unique_ptr<atomic<uint64_t>[]> slots;
+    vector<int> tokens;           // Arena: oznakowanie id zajmuje [id * width, (id + 1) * width).
+    vector<uint64_t> hashes;
+    atomic<size_t> count{0};
+    size_t grows = 0;
+
+    void allocate(size_t capacity) {
+        slotCount = capacity;
+        limit = capacity * MAX_LOAD_NUM / MAX_LOAD_DEN;
+        slots.reset(new atomic<uint64_t>[capacity]);
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].store(0, memory_order_relaxed);
+        }
+        tokens.assign((limit + extraIds) * width, 0);
+        hashes.assign(limit + extraIds, 0);
+    }
+};
+
+struct ReachabilityStats {
+    size_t states = 0;            // Osiągalne oznakowania.
+    size_t edges = 0;             // Krawędzie grafu osiągalności (odpalenia).
+    size_t levels = 0;            // Rundy BFS (poziomy plus ewentualne powtórzenia po powiększeniu tablicy).
+    size_t tableGrows = 0;
+    size_t threads = 1;
+    double seconds = 0.0;
+};
+
+// BFS poziomami: bieżąca granica dzielona jest na bloki wykonywane w puli wątków, każdy blok
+// zapisuje nowe oznakowania do własnego bufora, a bufory skleja się w następną granicę.
+// Oznakowania, których nie dało się dokończyć z powodu zapełnionej tablicy, są wznawiane od
+// przerwanego przejścia po jej powiększeniu. Przy jednym wątku numeracja id jest deterministyczna.
+ReachabilityStats exploreReachableParallel(const PetriNet& net, ConcurrentMarkingTable& table, size_t threads) {
+    STATS_TIMER(explore);
+    struct Work {
+        uint32_t markingId;
+        uint32_t nextTransition;
+    };
+
+    auto start = chrono::steady_clock::now();
+    WorkStealingPool pool(threads);
+    ReachabilityStats stats;
+    stats.threads = pool.threadCount();
+    const size_t transitionCount = net.transitions.size();
+
+    table.insert(net.initialMarking.data(), MarkingStore::hashMarking(net.initialMarking));
+    vector<Work> frontier = {{0, 0}};
+
+    while (!frontier.empty()) {
+        if (table.halfFull()) {
+            table.grow(); // Między poziomami, żeby rzadziej przerywać rozwijanie.
+        }
+        size_t blocks = min(frontier.size(), pool.threadCount() * 8);
+        vector<vector<Work>> produced(blocks), deferred(blocks);
+        vector<size_t> edges(blocks, 0);
+
+        pool.parallelFor(blocks, [&](size_t block) {
+            Marking marking(net.places.size());
+            Bitset enabled;       // Aktywne przejścia gęstej sieci (apply/undo przywracają oznakowanie).
+            for (size_t i = frontier.size() * block / blocks; i < frontier.size() * (block + 1) / blocks; ++i) {
+                const Work& work = frontier[i];
+                const int* source = table.marking(work.markingId);
+                copy(source, source + marking.size(), marking.begin());
+                uint64_t hash = table.hashOf(work.markingId);
+                if (!net.sparse) {
+                    enabledTransitionsDense(net, marking, enabled);
+                }
+                for (size_t t = work.nextTransition; t < transitionCount; ++t) {
+                    if (net.sparse ? !isTransitionEnabledSparse(net, marking, t) : !enabled.test(t)) {
+                        continue;
+                    }
+                    applyTransition(net, marking, t, hash);
+                    auto [id, result] = table.insert(marking.data(), hash);
+                    undoTransition(net, marking, t, hash);
+                    if (result == ConcurrentMarkingTable::InsertResult::Full) {
+                        deferred[block].push_back({work.markingId, static_cast<uint32_t>(t)});
+                        break;
+                    }
+                    edges[block]++;
+                    if (result == ConcurrentMarkingTable::InsertResult::Inserted) {
+                        produced[block].push_back({id, 0});
+                    }
+                }
+            }
+        });
+
+        bool tableFull = false;
+        frontier.clear();
+        for (size_t block = 0; block < blocks; ++block) {
+            stats.edges += edges[block];
+            tableFull = tableFull || !deferred[block].empty();
+            frontier.insert(frontier.end(), deferred[block].begin(), deferred[block].end());
+        }
+        for (size_t block = 0; block < blocks; ++block) {
+            frontier.insert(frontier.end(), produced[block].begin(), produced[block].end());
+        }
+        if (tableFull) {
+            table.grow();
+        }
+        stats.levels++;
+    }
+
+    stats.states = table.size();
+    stats.tableGrows = table.growCount();
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Zapisuje osiągalne oznakowania (w kolejności id) do pliku JSON.
+void saveReachableToJSON(const string& filename, const PetriNet& net, const ConcurrentMarkingTable& table, bool compact = false) {
+    STATS_TIMER(save);
+    JsonStreamWriter writer(filename, compact);
+    writer.beginObject();
+    writer.key("Markings");
+    writer.beginArray();
+    for (uint32_t id = 0; id < table.size(); ++id) {
+        writer.numberArray(table.marking(id), net.places.size());
+    }
+    writer.endArray();
+    writer.endObject();
+    writer.close();
+}
+
+// Wypisuje statystyki tablicy odwiedzonych oznakowań.
+template <typename Store>
+void printStoreStatistics(const Store& markingHistory, ostream& out = cout) {
+    const typename Store::Stats& stats = markingHistory.statistics();
+    out << "Odwiedzone oznakowania: " << markingHistory.size()
+         << ", wypełnienie tablicy: " << markingHistory.loadFactor()
+         << " (" << markingHistory.size() << "/" << markingHistory.capacity() << ")"
+         << ", średnia liczba prób: " << markingHistory.averageProbes()
+         << ", maks. liczba prób: " << stats.maxProbe
+         << ", pamięć: " << markingHistory.memoryUsage() / 1024 << " KB" << endl;
+}
+
+void printExplorationStatistics(const ExplorationStats& stats, ostream& out = cout) {
+    out << "Odpalenia przejść: " << stats.firings << ", maks. liczba ramek: " << stats.peakFrontier
+         << (stats.truncated ? " (przerwano po osiągnięciu limitu)" : "") << endl;
+}
+
+// Mikrobenchmark jąder gęstych: dla kilku liczb miejsc mierzy średni czas sprawdzenia aktywności
+// (najgorszy przypadek - przejście aktywne, więc sprawdzany jest cały wektor) i wersji wsadowej (jedno oznakowanie względem wszystkich przejść) dla każdego dostępnego wariantu.
+void runKernelBenchmarks() {
+    const size_t transitionCount = 64;
+    mt19937 random(12345);
+    uniform_int_distribution<int> weight(0, 2);
+
+    cout << left << setw(10) << "miejsca" << setw(10) << "jądro"
+         << right << setw(14) << "enabled [ns]" << setw(14) << "wsad [ns]"
+         << setw(12) << "przyspiesz." << endl;
+
+    for (size_t placeCount : {16, 256, 4096, 65536}) {
+        vector<int> pre(transitionCount * placeCount);
+        for (size_t i = 0; i < pre.size(); ++i) {
+            pre[i] = weight(random);
+        }
+        Marking marking(placeCount, 2); // Wystarczy tokenów dla każdego przejścia.
+        size_t repetitions = max<size_t>(1, (size_t(1) << 26) / (placeCount * transitionCount));
+
+        double scalarEnabled = 0;
+        vector<DenseKernels> kernels = availableDenseKernels();
+        reverse(kernels.begin(), kernels.end()); // Najpierw wersja skalarna (punkt odniesienia).
+        for (const DenseKernels& kernel : kernels) {
+            size_t checksum = 0;
+            auto start = chrono::steady_clock::now();
+            for (size_t r = 0; r < repetitions; ++r) {
+                for (size_t t = 0; t < transitionCount; ++t) {
+                    checksum += kernel.enabled(marking.data(), pre.data() + t * placeCount, placeCount);
+                }
+            }
+            auto end = chrono::steady_clock::now();
+
+            // Wersja wsadowa: jedno oznakowanie względem wszystkich przejść, wynik jako zbiór bitów.
+            Bitset enabled;
+            auto batchStart = chrono::steady_clock::now();
+            for (size_t r = 0; r < repetitions; ++r) {
+                enabledTransitionsDense(kernel, marking.data(), pre.data(), placeCount, transitionCount, enabled);
+                checksum += enabled.count();
+            }
+            auto batchEnd = chrono::steady_clock::now();
+
+            double calls = static_cast<double>(repetitions * transitionCount);
+            double enabledNs = chrono::duration<double, nano>(end - start).count() / calls;
+            double batchNs = chrono::duration<double, nano>(batchEnd - batchStart).count() / repetitions;
+            if (scalarEnabled == 0) {
+                scalarEnabled = enabledNs;
+            }
+            cout << left << setw(10) << placeCount << setw(10) << kernel.name
+                 << right << fixed << setprecision(1) << setw(14) << enabledNs << setw(14) << batchNs
+                 << setw(11) << setprecision(2) << scalarEnabled / enabledNs << "x"
+                 << (checksum == 0 ? " " : "") << endl; // checksum zapobiega usunięciu pętli przez kompilator.
+        }
+        cout.unsetf(ios::fixed);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark: sparametryzowane klasyczne modele (rozmiar N) i pomiar wczytywania, rozwijania
+// i zapisu prefiksu z wynikiem w formacie JSON.
+// ---------------------------------------------------------------------------
+
+// Buduje sieć z list łuków (nazwy p1.., t1.. jak przy wczytywaniu z pliku).
+PetriNet makeNet(size_t placeCount, size_t transitionCount, const Marking& initialMarking, const vector<Arc>& preArcs, const vector<Arc>& postArcs) {
+    PetriNet net;
+    net.initialMarking = initialMarking;
+    for (size_t i = 1; i <= placeCount; ++i) {
+        net.places.push_back("p" + to_string(i));
+    }
+    for (size_t i = 1; i <= transitionCount; ++i) {
+        net.transitions.push_back("t" + to_string(i));
+    }
+    buildTransitionArrays(net, preArcs, postArcs);
+    return net;
+}
+
+// Pomocnik generatorów: przejście t konsumuje z miejsc inputs i produkuje do outputs (wagi 1).
+struct NetGenerator {
+    size_t placeCount = 0;
+    size_t transitionCount = 0;
+    Marking initialMarking;
+    vector<Arc> preArcs, postArcs;
+
+    uint32_t place(int tokens = 0) {
+        initialMarking.push_back(tokens);
+        return static_cast<uint32_t>(placeCount++);
+    }
+
+    void transition(initializer_list<uint32_t> inputs, initializer_list<uint32_t> outputs) {
+        uint32_t t = static_cast<uint32_t>(transitionCount++);
+        for (uint32_t p : inputs) preArcs.push_back({p, t, 1});
+        for (uint32_t p : outputs) postArcs.push_back({p, t, 1});
+    }
+
+    PetriNet build() const { return makeNet(placeCount, transitionCount, initialMarking, preArcs, postArcs); }
+};
+
+// Filozofowie: każdy bierze najpierw lewy, potem prawy widelec (z możliwym zakleszczeniem).
+PetriNet generatePhilosophers(size_t n) {
+    NetGenerator g;
+    vector<uint32_t> thinking, hasLeft, eating, fork;
+    for (size_t i = 0; i < n; ++i) {
+        thinking.push_back(g.place(1));
+        hasLeft.push_back(g.place());
+        eating.push_back(g.place());
+    }
+    for (size_t i = 0; i < n; ++i) {
+        fork.push_back(g.place(1));
+    }
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t left = fork[i], right = fork[(i + 1) % n];
+        g.transition({thinking[i], left}, {hasLeft[i]});
+        g.transition({hasLeft[i], right}, {eating[i]});
+        g.transition({eating[i]}, {thinking[i], left, right});
+    }
+    return g.build();
+}
+
+// Wzajemne wykluczanie (DME) z żetonem krążącym w pierścieniu: komórka z żetonem może wejść do
+// sekcji krytycznej, jeśli zgłosiła żądanie, albo przekazać żeton dalej, jeśli żądania nie ma.
+PetriNet generateDME(size_t n) {
+    NetGenerator g;
+    vector<uint32_t> idle, requesting, critical, token;
+    for (size_t i = 0; i < n; ++i) {
+        idle.push_back(g.place(1));
+        requesting.push_back(g.place());
+        critical.push_back(g.place());
+        token.push_back(g.place(i == 0 ? 1 : 0));
+    }
+    for (size_t i = 0; i < n; ++i) {
+        g.transition({idle[i]}, {requesting[i]});                        // Żądanie.
+        g.transition({requesting[i], token[i]}, {critical[i]});          // Wejście.
+        g.transition({critical[i]}, {idle[i], token[i]});                // Wyjście.
+        g.transition({idle[i], token[i]}, {idle[i], token[(i + 1) % n]}); // Przekazanie (test idle).
+    }
+    return g.build();
+}
+
+// Pierścień stacji: stacja z żetonem przekazuje go dalej albo wykonuje pracę i oddaje żeton po niej.
+PetriNet generateTokenRing(size_t n) {
+    NetGenerator g;
+    vector<uint32_t> token, free, busy;
+    for (size_t i = 0; i < n; ++i) {
+        token.push_back(g.place(i == 0 ? 1 : 0));
+        free.push_back(g.place(1));
+        busy.push_back(g.place());
+    }
+    for (size_t i = 0; i < n; ++i) {
+        g.transition({token[i]}, {token[(i + 1) % n]});
+        g.transition({token[i], free[i]}, {busy[i]});
+        g.transition({busy[i]}, {free[i], token[(i + 1) % n]});
+    }
+    return g.build();
+}
+
+// Producent i konsument połączeni łańcuchem N jednoelementowych buforów.
+PetriNet generateBufferChain(size_t n) {
+    NetGenerator g;
+    vector<uint32_t> empty, full;
+    for (size_t i = 0; i < n; ++i) {
+        empty.push_back(g.place(1));
+        full.push_back(g.place());
+    }
+    g.transition({empty[0]}, {full[0]}); // Producent.
+    for (size_t i = 0; i + 1 < n; ++i) {
+        g.transition({full[i], empty[i + 1]}, {empty[i], full[i + 1]});
+    }
+    g.transition({full[n - 1]}, {empty[n - 1]}); // Konsument.
+    return g.build();
+}
+
+// Planista cykliczny Milnera: cykler startuje, gdy ma żeton i jest gotowy, od razu przekazuje
+// żeton następnemu i kończy pracę niezależnie od pozostałych.
+PetriNet generateCyclic(size_t n) {
+    NetGenerator g;
+    vector<uint32_t> token, ready, busy;
+    for (size_t i = 0; i < n; ++i) {
+        token.push_back(g.place(i == 0 ? 1 : 0));
+        ready.push_back(g.place(1));
+        busy.push_back(g.place());
+    }
+    for (size_t i = 0; i < n; ++i) {
+        g.transition({token[i], ready[i]}, {busy[i], token[(i + 1) % n]});
+        g.transition({busy[i]}, {ready[i]});
+    }
+    return g.build();
+}
+
+// Szczytowe zużycie pamięci procesu (w kB).
+size_t peakResidentKilobytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss); // Linux podaje ru_maxrss w kB.
+#endif
+}
+
+// Modele benchmarku: nazwa i generator sieci o rozmiarze N (N >= 2, inaczej filozof miałby jeden widelec).
+using NetGeneratorFunction = PetriNet (*)(size_t);
+const pair<const char*, NetGeneratorFunction> benchmarkModels[] = {
+    {"philosophers", generatePhilosophers},
+    {"dme", generateDME},
+    {"token_ring", generateTokenRing},
+    {"buffer_chain", generateBufferChain},
+    {"cyclic", generateCyclic},
+};
+
+// Jeden pomiar: zapis sieci do pliku tymczasowego, a następnie osobno mierzone wczytanie (loadFromJSON),
+// rozwinięcie (unfoldingMcMillan) i zapis prefiksu. Pliki tymczasowe mają w nazwie PID procesu, więc
+// równoległe benchmarki ich sobie nie nadpisują.
+json runBenchmarkCase(const string& model, size_t n, const UnfoldingOptions& options) {
+    auto found = find_if(begin(benchmarkModels), end(benchmarkModels),
+                         [&](const auto& entry) { return model == entry.first; });
+    if (found == end(benchmarkModels)) {
+        throw runtime_error("Nieznany model benchmarku: " + model);
+    }
+    auto seconds = [](chrono::steady_clock::time_point from, chrono::steady_clock::time_point to) {
+        return chrono::duration<double>(to - from).count();
+    };
+#ifdef _WIN32
+    string tag = to_string(GetCurrentProcessId());
+#else
+    string tag = to_string(getpid());
+#endif
+    filesystem::path directory = filesystem::temp_directory_path();
+    string netFile = (directory / ("unfolding_bench_" + tag + "_net.json")).string();
+    string prefixFile = (directory / ("unfolding_bench_" + tag + "_prefix.json")).string();
+
+    saveNetToJSON(netFile, found->second(n), true);
+    auto start = chrono::steady_clock::now();
+    PetriNet net = loadFromJSON(netFile);
+    auto loaded = chrono::steady_clock::now();
+    Prefix prefix = unfoldingMcMillan(net, options);
+    auto unfolded = chrono::steady_clock::now();
+    savePrefixToJSON(prefixFile, net, prefix);
+    auto saved = chrono::steady_clock::now();
+    remove(netFile.c_str());
+    remove(prefixFile.c_str());
+
+    json result;
+    result["model"] = model;
+    result["n"] = n;
+    result["places"] = net.places.size();
+    result["transitions"] = net.transitions.size();
+    result["events"] = prefix.events.size();
+    result["conditions"] = prefix.conditions.size();
+    result["cutoffs"] = prefix.cutoffCount;
+    result["truncated"] = prefix.truncated;
+    result["loadSeconds"] = seconds(start, loaded);
+    result["unfoldSeconds"] = seconds(loaded, unfolded);
+    result["saveSeconds"] = seconds(unfolded, saved);
+    result["wallSeconds"] = seconds(start, saved);
+    result["peakRssKB"] = peakResidentKilobytes();
+    return result;
+}
+
+// Dla każdego modelu i rozmiaru uruchamia pomiar w osobnym procesie (program --bench-case MODEL N),
+// żeby peakRssKB był szczytem pamięci tego jednego pomiaru, a nie całego benchmarku. Wynik na stdout w JSON.
+void runBenchmarks(const string& program, const vector<size_t>& sizes, const UnfoldingOptions& options) {
+    json results = json::array();
+    for (const auto& model : benchmarkModels) {
+        for (size_t n : sizes) {
+            string command = "\"" + program + "\" --bench-case " + model.first + " " + to_string(n) + " --order "
+                + (options.order == AdequateOrder::ERV ? "erv" : "mcmillan") + " --threads "
+                + to_string(options.threads) + " --max-events " + to_string(options.maxEvents);
+            FILE* pipe = popen(command.c_str(), "r");
+            if (!pipe) {
+                throw runtime_error("Nie można uruchomić pomiaru: " + command);
+            }
+            string output;
+            char buffer[4096];
+            for (size_t read; (read = fread(buffer, 1, sizeof(buffer), pipe)) > 0;) {
+                output.append(buffer, read);
+            }
+            if (pclose(pipe) != 0 || output.empty()) {
+                throw runtime_error("Pomiar " + string(model.first) + " N=" + to_string(n) + " nie powiódł się");
+            }
+            results.push_back(json::parse(output));
+        }
+    }
+    cout << results.dump(4) << endl;
+}
+
+#ifdef UNFOLDING_STATS
+// Zapisuje liczniki obok pliku wynikowego (output.json -> output.stats.json).
+void saveStatsToJSON(const string& outputFile) {
+    json j;
+    j["markingsVisited"] = engineStats.markingsVisited;
+    j["duplicatesHit"] = engineStats.duplicatesHit;
+    j["transitionsTested"] = engineStats.transitionsTested;
+    j["transitionsEnabled"] = engineStats.transitionsEnabled;
+    j["columnsAdded"] = engineStats.columnsAdded;
+    j["cycleColumnsAdded"] = engineStats.cycleColumnsAdded;
+    j["rowsAdded"] = engineStats.rowsAdded;
+    j["maxDepth"] = engineStats.maxDepth;
+    j["loadSeconds"] = engineStats.loadSeconds;
+    j["exploreSeconds"] = engineStats.exploreSeconds;
+    j["saveSeconds"] = engineStats.saveSeconds;
+
+    string filename = filesystem::path(outputFile).replace_extension(".stats.json").string();
+    ofstream file(filename);
+    file << j.dump(4);
+    file.close();
+    if (!file) {
+        throw runtime_error("Błąd zapisu pliku wyjściowego: " + filename);
+    }
+}
+#endif
+
+// Sposób przechowywania oznakowań w silniku DFS.
+enum class MarkingMode {
+    Auto,                         // Bitowo, jeśli sieć na to pozwala; w razie wykrycia 2 tokenów powrót do ogólnego.
+    Safe,                         // Zawsze bitowo (błąd, jeśli sieć nie jest bezpieczna).
+    General                       // Wektory liczników tokenów.
+};
+
+// Ustawienia uruchomienia silnika, wspólne dla pojedynczego pliku i trybu wsadowego.
+struct RunConfig {
+    string engine = "dfs";        // "dfs" (przeszukiwanie oznakowań), "mcmillan" (prefiks rozwinięcia) albo "reach" (równoległy BFS).
+    UnfoldingOptions options;
+    MarkingMode markingMode = MarkingMode::Auto;
+    ExplorationOptions exploration;
+    bool compactOutput = false;   // Wynik bez wcięć (mniejszy plik, szybszy zapis).
+};
+
+// Wynik jednego uruchomienia (wiersz tabeli podsumowania w trybie wsadowym).
+struct RunSummary {
+    size_t places = 0;
+    size_t transitions = 0;
+    size_t results = 0;           // Zdarzenia (mcmillan) albo oznakowania (dfs, reach).
+    bool truncated = false;       // Przerwano po osiągnięciu limitu.
+    double seconds = 0.0;
+    string error;                 // Pusty, jeśli uruchomienie się powiodło.
+};
+
+// Wczytuje sieć, uruchamia wybrany silnik i zapisuje wynik. Komunikaty trafiają do log; błędy
+// wejścia zgłaszane są wyjątkami.
+RunSummary runEngine(const RunConfig& config, const string& inputFile, const string& outputFile, ostream& log) {
+    STATS_RESET();
+    auto start = chrono::steady_clock::now();
+    RunSummary summary;
+
+    LoadStats loadStats;
+    PetriNet net = loadNet(inputFile, &loadStats); // Wczytuje sieć Petriego z pliku (JSON albo binarnego).
+    summary.places = net.places.size();
+    summary.transitions = net.transitions.size();
+    log << "Wczytano " << inputFile << ": " << fixed << setprecision(2) << loadStats.bytes / 1e6 << " MB w "
+        << setprecision(3) << loadStats.seconds << " s (" << setprecision(1)
+        << loadStats.bytes / 1e6 / max(loadStats.seconds, 1e-9) << " MB/s)" << defaultfloat << setprecision(6) << endl;
+
+    if (config.engine == "mcmillan") {
+        Prefix prefix = unfoldingMcMillan(net, config.options); // Buduje skończony kompletny prefiks.
+        savePrefix(outputFile, net, prefix, config.compactOutput);
+        summary.results = prefix.events.size();
+        summary.truncated = prefix.truncated;
+
+        log << "Algorytm unfolding zakończony. Wynik zapisano do pliku " << outputFile << endl;
+        log << "Zdarzenia: " << prefix.events.size() << ", warunki: " << prefix.conditions.size()
+            << ", zdarzenia odcinające: " << prefix.cutoffCount
+            << (prefix.truncated ? " (przerwano po osiągnięciu limitu zdarzeń)" : "") << endl;
+        if (prefix.unsafe && config.options.order == AdequateOrder::ERV) {
+            log << "Uwaga: sieć nie jest bezpieczna; porządek ERV nie ogranicza wtedy liczby zdarzeń"
+                << " nieodcinających do liczby osiągalnych oznakowań" << endl;
+        }
+        log << "Kolejka rozszerzeń: maks. rozmiar " << prefix.peakQueueSize
+            << ", porównania: " << prefix.queueComparisons
+            << ", wyznaczone postacie Foaty: " << prefix.foataComputations << endl;
+        if (prefix.threads > 1) {
+            log << "Wątki: " << prefix.threads << ", zadania rozszerzeń: " << prefix.extensionTasks
+                << ", skradzione zadania: " << prefix.stolenTasks << endl;
+        }
+    } else if (config.engine == "reach") {
+        size_t threads = resolveThreadCount(config.options.threads);
+        ConcurrentMarkingTable table(net.places.size(), threads);
+        ReachabilityStats stats = exploreReachableParallel(net, table, threads);
+        saveReachableToJSON(outputFile, net, table, config.compactOutput);
+        summary.results = stats.states;
+
+        log << "Przeszukiwanie wszerz zakończone. Osiągalne oznakowania zapisano do pliku " << outputFile << endl;
+        log << "Stany: " << stats.states << ", krawędzie: " << stats.edges << ", rundy: " << stats.levels
+            << ", powiększenia tablicy: " << stats.tableGrows << ", wątki: " << stats.threads << endl;
+        log << "Czas: " << stats.seconds << " s, " << static_cast<size_t>(stats.states / max(stats.seconds, 1e-9))
+            << " stanów/s, " << static_cast<size_t>(stats.edges / max(stats.seconds, 1e-9)) << " krawędzi/s" << endl;
+    } else if (config.engine == "dfs") {
+        bool done = false;
+        if (config.markingMode == MarkingMode::Safe && !canUseSafeMode(net)) {
+            throw runtime_error("Tryb bitowy wymaga wag łuków 1 i oznakowania początkowego 0/1");
+        }
+        if (config.markingMode != MarkingMode::General && canUseSafeMode(net)) {
+            try {
+                PackedMarkingStore markingHistory; // Odwiedzone oznakowania upakowane bitowo.
+                ExplorationStats stats;
+                ResultMatrixBuilder resultMatrix = unfoldingSafe(net, markingHistory, config.exploration, stats);
+                saveToJSON(outputFile, resultMatrix, {}, {}, config.compactOutput); // Zapisuje wynik do pliku JSON.
+                summary.results = stats.states;
+                summary.truncated = stats.truncated;
+
+                log << "Algorytm unfolding zakończony (oznakowania bitowe). Wynik zapisano do pliku " << outputFile << endl;
+                printStoreStatistics(markingHistory, log);
+                printExplorationStatistics(stats, log);
+                done = true;
+            } catch (const UnsafeNetError& error) {
+                if (config.markingMode == MarkingMode::Safe) {
+                    throw;
+                }
+                log << error.what() << "; powtórzenie z oznakowaniami ogólnymi" << endl;
+                STATS_RESTART(); // Liczniki przerwanego przebiegu bitowego nie trafiają do statystyk.
+            }
+        }
+        if (!done) {
+            MarkingStore markingHistory; // Odwiedzone oznakowania (tablica haszująca).
+            ExplorationStats stats;
+            auto [resultMatrix, mappings] = unfolding(net, markingHistory, config.exploration, stats); // Przeprowadza unfolding i otrzymuje wynikową macierz i mapowania.
+            auto [resultPlaces, resultTransitions] = mappings; // Rozpakowuje mapowania miejsc i przejść.
+
+            saveToJSON(outputFile, resultMatrix, resultPlaces, resultTransitions, config.compactOutput); // Zapisuje wynik do pliku JSON.
+            summary.results = stats.states;
+            summary.truncated = stats.truncated;
+
+            log << "Algorytm unfolding zakończony. Wynik zapisano do pliku " << outputFile << endl;
+            printStoreStatistics(markingHistory, log);
+            printExplorationStatistics(stats, log);
+        }
+    } else {
+        throw runtime_error("Nieznany silnik: " + config.engine);
+    }
+
+    STATS_DUMP(outputFile); // Liczniki obok wyniku (tylko z -DUNFOLDING_STATS).
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+// Tryb wsadowy: każda sieć (*.json, *.bin) z katalogu wejściowego jest osobnym zadaniem puli wątków,
+// a wynik trafia do katalogu wyjściowego pod pełną nazwą wejścia z dopisanym .json (a.bin -> a.bin.json),
+// więc a.json i a.bin nie nadpisują nawzajem swoich wyników. Sieci są przetwarzane
+// jednowątkowo, żeby pule silników nie konkurowały z pulą wsadową. Na końcu wypisywana jest tabela.
+int runBatch(RunConfig config, const string& inputDirectory, string outputDirectory, size_t jobs) {
+    if (!filesystem::is_directory(inputDirectory)) {
+        cerr << "Błąd: nie ma katalogu " << inputDirectory << endl;
+        return 1;
+    }
+    if (outputDirectory.empty()) {
+        outputDirectory = (filesystem::path(inputDirectory) / "unfolded").string();
+    }
+    filesystem::create_directories(outputDirectory);
+    if (filesystem::equivalent(inputDirectory, outputDirectory)) {
+        cerr << "Błąd: katalog wyników nie może być katalogiem wejściowym: " << outputDirectory << endl;
+        return 1;
+    }
+    config.options.threads = 1;
+
+    vector<filesystem::path> inputs;
+    for (const auto& entry : filesystem::directory_iterator(inputDirectory)) {
+        string extension = entry.path().extension().string();
+        if (entry.is_regular_file() && (extension == ".json" || extension == ".bin")) {
+            inputs.push_back(entry.path());
+        }
+    }
+    sort(inputs.begin(), inputs.end());
+
+    vector<RunSummary> summaries(inputs.size());
+    auto start = chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(jobs);
+        pool.parallelFor(inputs.size(), [&](size_t i) {
+            string outputFile = (filesystem::path(outputDirectory) / inputs[i].filename()).string() + ".json";
+            ostringstream log; // Komunikaty pojedynczych sieci nie są wypisywane w trybie wsadowym.
+            try {
+                summaries[i] = runEngine(config, inputs[i].string(), outputFile, log);
+            } catch (const exception& error) {
+                summaries[i].error = error.what();
+            }
+        });
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    // setw liczy bajty, więc nagłówki z polskimi znakami (2 bajty w UTF-8) mają szerokość o 1 większą.
+    cout << left << setw(33) << "sieć" << setw(8) << "status" << right << setw(10) << "miejsca"
+         << setw(12) << "przejścia" << setw(12) << "wynik" << setw(12) << "czas [s]" << endl;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const RunSummary& summary = summaries[i];
+        cout << left << setw(32) << inputs[i].filename().string();
+        if (!summary.error.empty()) {
+            failed++;
+            cout << "BŁĄD    " << summary.error << endl;
+            continue;
+        }
+        cout << setw(8) << (summary.truncated ? "LIMIT" : "OK") << right << setw(10) << summary.places
+             << setw(11) << summary.transitions << setw(12) << summary.results
+             << setw(12) << fixed << setprecision(3) << summary.seconds << defaultfloat << endl;
+    }
+    cout << "Sieci: " << inputs.size() << ", błędy: " << failed << ", czas: " << fixed << setprecision(3) << seconds
+         << " s (" << setprecision(1) << inputs.size() / max(seconds, 1e-9) << " sieci/s), wyniki w " << outputDirectory
+         << defaultfloat << setprecision(6) << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Odczytuje liczbę całkowitą z argumentu opcji; odrzuca znak, śmieci po liczbie, przepełnienie
+// i wartości mniejsze niż minimum.
+size_t parseCount(const string& text, const string& option, size_t minimum = 0) {
+    size_t value = 0;
+    const char* end = text.data() + text.size();
+    auto [stop, error] = from_chars(text.data(), end, value);
+    if (error == errc::result_out_of_range) {
+        throw runtime_error("Zbyt duża liczba w opcji " + option + ": " + text);
+    }
+    if (error != errc() || stop != end) {
+        throw runtime_error("Niepoprawna liczba w opcji " + option + ": " + text);
+    }
+    if (value < minimum) {
+        throw runtime_error("Opcja " + option + " wymaga liczby co najmniej " + to_string(minimum) + ": " + text);
+    }
+    return value;
+}
+
+void printUsage(const char* program) {
+    cout << "Użycie: " << program << " [opcje]\n"
+         << "  -i, --input PLIK         sieć wejściowa JSON albo binarna (domyślnie input.json)\n"
+         << "  -o, --output PLIK        plik wynikowy (domyślnie output.json; .bin = prefiks binarny)\n"
+         << "  --engine dfs|mcmillan|reach\n"
+         << "                           przeszukiwanie oznakowań (domyślnie), prefiks rozwinięcia,\n"
+         << "                           zbiór osiągalny\n"
+         << "  --order erv|mcmillan     porządek adekwatny silnika mcmillan (erv daje najmniejszy\n"
+         << "                           prefiks tylko dla sieci bezpiecznych)\n"
+         << "  --threads N              wątki silników mcmillan i reach (0 = liczba rdzeni)\n"
+         << "  --max-events N           limit zdarzeń prefiksu\n"
+         << "  --markings auto|safe|general, --search dfs|bfs\n"
+         << "  --max-states N, --max-frontier N, --max-memory MB\n"
+         << "                           opcje i limity silnika dfs\n"
+         << "  --compact                wynik JSON bez wcięć\n"
+         << "  --batch KATALOG          przetwarza wszystkie sieci (*.json, *.bin) z katalogu\n"
+         << "  --output-dir KATALOG     katalog wyników trybu wsadowego (domyślnie KATALOG/unfolded,\n"
+         << "                           wynik sieci a.bin to a.bin.json)\n"
+         << "  --jobs N                 liczba sieci przetwarzanych naraz (domyślnie liczba rdzeni)\n"
+         << "  --convert WEJ WYJ        konwersja JSON <-> format binarny\n"
+         << "  --bench [--bench-sizes 4,8,16,32], --bench-kernels\n"
+         << "                           benchmarki modeli (N >= 2, każdy pomiar w osobnym procesie)\n"
+         << "                           i jąder SIMD" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string inputFile = "input.json"; // Plik wejściowy JSON.
+    string outputFile = "output.json"; // Plik wyjściowy JSON.
+    RunConfig config;
+    bool benchmark = false;
+    vector<size_t> benchmarkSizes = {4, 8, 16, 32}; // Rozmiary N modeli w trybie --bench.
+    string benchmarkCase; // Model pojedynczego pomiaru (--bench-case).
+    size_t benchmarkCaseSize = 0;
+    string batchDirectory, outputDirectory;
+    string convertFrom, convertTo; // Pliki konwersji --convert.
+    size_t jobs = max<size_t>(thread::hardware_concurrency(), 1);
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if ((arg == "-i" || arg == "--input") && i + 1 < argc) {
+                inputFile = argv[++i];
+            } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+                outputFile = argv[++i];
+            } else if (arg == "--batch" && i + 1 < argc) {
+                batchDirectory = argv[++i];
+            } else if (arg == "--output-dir" && i + 1 < argc) {
+                outputDirectory = argv[++i];
+            } else if (arg == "--jobs" && i + 1 < argc) {
+                jobs = max<size_t>(parseCount(argv[++i], "--jobs"), 1);
+            } else if (arg == "--bench-kernels") {
+                runKernelBenchmarks(); // Mikrobenchmark jąder SIMD (nie wczytuje sieci).
+                return 0;
+            } else if (arg == "--bench") {
+                benchmark = true; // Uruchamiany po odczytaniu pozostałych opcji (porządek, wątki, limit).
+            } else if (arg == "--bench-sizes" && i + 1 < argc) {
+                benchmarkSizes.clear();
+                stringstream list(argv[++i]);
+                for (string size; getline(list, size, ',');) {
+                    benchmarkSizes.push_back(parseCount(size, "--bench-sizes", 2));
+                }
+            } else if (arg == "--bench-case" && i + 2 < argc) {
+                benchmarkCase = argv[++i]; // Pojedynczy pomiar w procesie potomnym, uruchamiany przez --bench.
+                benchmarkCaseSize = parseCount(argv[++i], "--bench-case", 2);
+            } else if (arg == "--engine" && i + 1 < argc) {
+                config.engine = argv[++i];
+                if (config.engine != "mcmillan" && config.engine != "dfs" && config.engine != "reach") {
+                    cerr << "Nieznany silnik: " << config.engine << endl;
+                    return 1;
+                }
+            } else if (arg == "--order" && i + 1 < argc) {
+                string order = argv[++i];
+                if (order == "erv") {
+                    config.options.order = AdequateOrder::ERV;
+                } else if (order == "mcmillan") {
+                    config.options.order = AdequateOrder::McMillan;
+                } else {
+                    cerr << "Nieznany porządek: " << order << endl;
+                    return 1;
+                }
+            } else if (arg == "--threads" && i + 1 < argc) {
+                config.options.threads = parseCount(argv[++i], "--threads");
+            } else if (arg == "--markings" && i + 1 < argc) {
+                string mode = argv[++i];
+                if (mode == "auto") {
+                    config.markingMode = MarkingMode::Auto;
+                } else if (mode == "safe") {
+                    config.markingMode = MarkingMode::Safe;
+                } else if (mode == "general") {
+                    config.markingMode = MarkingMode::General;
+                } else {
+                    cerr << "Nieznany tryb oznakowań: " << mode << endl;
+                    return 1;
+                }
+            } else if (arg == "--max-events" && i + 1 < argc) {
+                config.options.maxEvents = parseCount(argv[++i], "--max-events");
+            } else if (arg == "--convert" && i + 2 < argc) {
+                convertFrom = argv[++i]; // Uruchamiana po odczytaniu pozostałych opcji (np. --compact).
+                convertTo = argv[++i];
+            } else if (arg == "--compact") {
+                config.compactOutput = true;
+            } else if (arg == "--search" && i + 1 < argc) {
+                string order = argv[++i];
+                if (order == "dfs") {
+                    config.exploration.order = SearchOrder::DFS;
+                } else if (order == "bfs") {
+                    config.exploration.order = SearchOrder::BFS;
+                } else {
+                    cerr << "Nieznana kolejność przeszukiwania: " << order << endl;
+                    return 1;
+                }
+            } else if (arg == "--max-states" && i + 1 < argc) {
+                config.exploration.maxStates = parseCount(argv[++i], "--max-states");
+            } else if (arg == "--max-frontier" && i + 1 < argc) {
+                config.exploration.maxFrontier = parseCount(argv[++i], "--max-frontier");
+            } else if (arg == "--max-memory" && i + 1 < argc) {
+                string megabytes = argv[++i]; // Podawany w MB.
+                size_t limit = parseCount(megabytes, "--max-memory");
+                if (limit > SIZE_MAX / (1024 * 1024)) {
+                    throw runtime_error("Zbyt duża liczba w opcji --max-memory: " + megabytes);
+                }
+                config.exploration.maxMemoryBytes = limit * 1024 * 1024;
+            } else {
+                cerr << "Nieznany argument: " << arg << " (--help wypisuje opcje)" << endl;
+                return 1;
+            }
+        }
+
+        if (!convertFrom.empty()) {
+            convertFile(convertFrom, convertTo, config.compactOutput); // JSON <-> format binarny (sieć albo prefiks).
+            cout << "Przekonwertowano " << convertFrom << " -> " << convertTo << endl;
+            return 0;
+        }
+        if (!benchmarkCase.empty()) {
+            cout << runBenchmarkCase(benchmarkCase, benchmarkCaseSize, config.options).dump() << endl;
+            return 0;
+        }
+        if (benchmark) {
+            runBenchmarks(argv[0], benchmarkSizes, config.options);
+            return 0;
+        }
+        if (!batchDirectory.empty()) {
+            return runBatch(config, batchDirectory, outputDirectory, jobs);
+        }
+    } catch (const exception& error) {
+        cerr << "Błąd: " << error.what() << endl;
+        return 1;
+    }
+
+    try {
+        runEngine(config, inputFile, outputFile, cout);
+    } catch (const exception& error) {
+        cerr << "Błąd: " << error.what() << endl;
+        return 1;
+    }
     return 0; // Kończy program.
 }